@@ -0,0 +1,345 @@
+#include "AtlasCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	constexpr std::size_t MIN_MATCH = 4; ///< Shortest match the LZ4 block format can express
+	constexpr std::size_t LAST_LITERALS = 5; ///< The last bytes of a block are always literals
+	constexpr std::size_t MATCH_LIMIT = 12; ///< No match may start in the last bytes of a block
+	constexpr std::size_t MAX_OFFSET = 65535;
+	constexpr unsigned HASH_BITS = 12;
+
+	unsigned read32(const unsigned char *p)
+	{
+		unsigned v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	unsigned hash(unsigned v)
+	{
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	///Write an LZ4 length extension (runs of 255 followed by the remainder)
+	unsigned char* writeLength(unsigned char *op, std::size_t length)
+	{
+		while(length >= 255)
+		{
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = static_cast<unsigned char>(length);
+		return op;
+	}
+
+	///Read an LZ4 length extension, returns false if the block ends first
+	bool readLength(const unsigned char *&ip, const unsigned char *end, std::size_t &length)
+	{
+		unsigned char b;
+		do
+		{
+			if(ip >= end) return false;
+			b = *ip++;
+			length += b;
+		} while(b == 255);
+		return true;
+	}
+
+	///Worst case bytes needed for a sequence with the given literal count
+	std::size_t sequenceBound(std::size_t literals, std::size_t match)
+	{
+		return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+	}
+
+	///Decoded value for every 3-bit index of a BC4 block
+	void rgtc1Palette(unsigned char r0, unsigned char r1, int palette[8])
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+
+		if(r0 > r1)
+		{
+			for(int i = 2; i < 8; i++)
+				palette[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+		}
+		else
+		{
+			for(int i = 2; i < 6; i++)
+				palette[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	///Choose the nearest palette entry for each texel, returns the total squared error
+	unsigned rgtc1Indices(const unsigned char texels[16], const int palette[8], unsigned char indices[16])
+	{
+		unsigned total = 0;
+
+		for(int t = 0; t < 16; t++)
+		{
+			unsigned best = std::numeric_limits<unsigned>::max();
+			for(int i = 0; i < 8; i++)
+			{
+				int d = texels[t] - palette[i];
+				unsigned e = static_cast<unsigned>(d * d);
+				if(e < best)
+				{
+					best = e;
+					indices[t] = static_cast<unsigned char>(i);
+				}
+			}
+			total += best;
+		}
+
+		return total;
+	}
+}
+
+std::size_t AtlasCompression::lzBound(std::size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+std::size_t AtlasCompression::lzCompress(const unsigned char *src, std::size_t size, unsigned char *dst, std::size_t capacity)
+{
+	unsigned char *op = dst;
+	unsigned char *const oend = dst + capacity;
+	std::size_t anchor = 0; //First byte not yet emitted
+
+	if(size > MATCH_LIMIT)
+	{
+		unsigned table[1 << HASH_BITS];
+		std::fill(table, table + (1 << HASH_BITS), std::numeric_limits<unsigned>::max());
+
+		const std::size_t searchEnd = size - MATCH_LIMIT;
+		const std::size_t matchEnd = size - LAST_LITERALS;
+		std::size_t i = 0;
+
+		while(i < searchEnd)
+		{
+			unsigned sequence = read32(src + i);
+			unsigned &slot = table[hash(sequence)];
+			std::size_t candidate = slot;
+			slot = static_cast<unsigned>(i);
+
+			if(candidate == std::numeric_limits<unsigned>::max() || i - candidate > MAX_OFFSET || read32(src + candidate) != sequence)
+			{
+				i++;
+				continue;
+			}
+
+			std::size_t length = MIN_MATCH;
+			while(i + length < matchEnd && src[candidate + length] == src[i + length])
+				length++;
+
+			std::size_t literals = i - anchor;
+			if(static_cast<std::size_t>(oend - op) < sequenceBound(literals, length))
+				return 0;
+
+			unsigned char *token = op++;
+			*token = static_cast<unsigned char>((std::min<std::size_t>(literals, 15) << 4) | std::min<std::size_t>(length - MIN_MATCH, 15));
+			if(literals >= 15) op = writeLength(op, literals - 15);
+			std::memcpy(op, src + anchor, literals);
+			op += literals;
+
+			std::size_t offset = i - candidate;
+			*op++ = static_cast<unsigned char>(offset & 0xFF);
+			*op++ = static_cast<unsigned char>(offset >> 8);
+			if(length - MIN_MATCH >= 15) op = writeLength(op, length - MIN_MATCH - 15);
+
+			i += length;
+			anchor = i;
+		}
+	}
+
+	//Trailing literals
+	std::size_t literals = size - anchor;
+	if(static_cast<std::size_t>(oend - op) < sequenceBound(literals, 0))
+		return 0;
+
+	*op++ = static_cast<unsigned char>(std::min<std::size_t>(literals, 15) << 4);
+	if(literals >= 15) op = writeLength(op, literals - 15);
+	std::memcpy(op, src + anchor, literals);
+	op += literals;
+
+	return op - dst;
+}
+
+bool AtlasCompression::lzDecompress(const unsigned char *src, std::size_t size, unsigned char *dst, std::size_t capacity)
+{
+	const unsigned char *ip = src;
+	const unsigned char *const iend = src + size;
+	unsigned char *op = dst;
+	unsigned char *const oend = dst + capacity;
+
+	while(ip < iend)
+	{
+		unsigned char token = *ip++;
+
+		std::size_t literals = token >> 4;
+		if(literals == 15 && !readLength(ip, iend, literals))
+			return false;
+		if(literals > static_cast<std::size_t>(iend - ip) || literals > static_cast<std::size_t>(oend - op))
+			return false;
+
+		std::memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		if(ip == iend) //The last sequence has no match
+			break;
+
+		if(iend - ip < 2)
+			return false;
+		std::size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > static_cast<std::size_t>(op - dst))
+			return false;
+
+		std::size_t length = token & 15;
+		if(length == 15 && !readLength(ip, iend, length))
+			return false;
+		length += MIN_MATCH;
+		if(length > static_cast<std::size_t>(oend - op))
+			return false;
+
+		//Byte copy, the match may overlap the output
+		const unsigned char *match = op - offset;
+		for(std::size_t b = 0; b < length; b++)
+			*op++ = match[b];
+	}
+
+	return op == oend;
+}
+
+std::size_t AtlasCompression::rgtc1Size(int width, int height)
+{
+	return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+void AtlasCompression::rgtc1Encode(const unsigned char *bitmap, int width, int height, unsigned char *blocks)
+{
+	for(int by = 0; by < height; by += 4)
+	for(int bx = 0; bx < width; bx += 4)
+	{
+		unsigned char texels[16];
+		for(int t = 0; t < 16; t++)
+		{
+			//Clamp to the edge for partial blocks
+			int x = std::min(bx + (t & 3), width - 1);
+			int y = std::min(by + (t >> 2), height - 1);
+			texels[t] = bitmap[y * width + x];
+		}
+
+		//Eight interpolated values between the extremes
+		unsigned char lo = *std::min_element(texels, texels + 16);
+		unsigned char hi = *std::max_element(texels, texels + 16);
+
+		//Six interpolated values between the extremes excluding 0 and 255, which are explicit
+		unsigned char innerLo = 255, innerHi = 0;
+		for(int t = 0; t < 16; t++)
+		{
+			if(texels[t] == 0 || texels[t] == 255) continue;
+			innerLo = std::min(innerLo, texels[t]);
+			innerHi = std::max(innerHi, texels[t]);
+		}
+		if(innerLo > innerHi) innerLo = innerHi = 0;
+
+		int palette[8];
+		unsigned char eightIndices[16], sixIndices[16];
+
+		unsigned char r0 = hi, r1 = lo; //A solid block degenerates to the six value mode, which is still exact
+		rgtc1Palette(r0, r1, palette);
+		unsigned eightError = rgtc1Indices(texels, palette, eightIndices);
+
+		rgtc1Palette(innerLo, innerHi, palette);
+		unsigned sixError = rgtc1Indices(texels, palette, sixIndices);
+
+		const unsigned char *indices = eightIndices;
+		if(sixError < eightError)
+		{
+			r0 = innerLo;
+			r1 = innerHi;
+			indices = sixIndices;
+		}
+
+		unsigned long long bits = 0;
+		for(int t = 0; t < 16; t++)
+			bits |= static_cast<unsigned long long>(indices[t]) << (3 * t);
+
+		blocks[0] = r0;
+		blocks[1] = r1;
+		for(int b = 0; b < 6; b++)
+			blocks[2 + b] = static_cast<unsigned char>(bits >> (8 * b));
+
+		blocks += 8;
+	}
+}
+
+void AtlasCompression::rgtc1Decode(const unsigned char *blocks, int width, int height, unsigned char *bitmap)
+{
+	for(int by = 0; by < height; by += 4)
+	for(int bx = 0; bx < width; bx += 4)
+	{
+		int palette[8];
+		rgtc1Palette(blocks[0], blocks[1], palette);
+
+		unsigned long long bits = 0;
+		for(int b = 0; b < 6; b++)
+			bits |= static_cast<unsigned long long>(blocks[2 + b]) << (8 * b);
+
+		for(int t = 0; t < 16; t++)
+		{
+			int x = bx + (t & 3);
+			int y = by + (t >> 2);
+			if(x < width && y < height)
+				bitmap[y * width + x] = static_cast<unsigned char>(palette[(bits >> (3 * t)) & 7]);
+		}
+
+		blocks += 8;
+	}
+}
+
+AtlasCompression::Accuracy AtlasCompression::compare(const unsigned char *original, const unsigned char *decoded, std::size_t size)
+{
+	Accuracy result{ 0, 0.0, std::numeric_limits<double>::infinity(), 0 };
+	double absolute = 0.0, squared = 0.0;
+
+	for(std::size_t i = 0; i < size; i++)
+	{
+		int d = std::abs(original[i] - decoded[i]);
+		if(d == 0) continue;
+
+		result.maxError = std::max(result.maxError, d);
+		result.changed++;
+		absolute += d;
+		squared += static_cast<double>(d) * d;
+	}
+
+	if(size)
+		result.meanError = absolute / size;
+	if(squared > 0.0)
+		result.psnr = 10.0 * std::log10(255.0 * 255.0 / (squared / size));
+
+	return result;
+}
+
+AtlasCompression::Accuracy AtlasCompression::rgtc1Accuracy(const unsigned char *bitmap, int width, int height)
+{
+	std::size_t size = static_cast<std::size_t>(width) * height;
+	unsigned char *blocks = new unsigned char[rgtc1Size(width, height)];
+	unsigned char *decoded = new unsigned char[size];
+
+	rgtc1Encode(bitmap, width, height, blocks);
+	rgtc1Decode(blocks, width, height, decoded);
+	Accuracy result = compare(bitmap, decoded, size);
+
+	delete[] decoded;
+	delete[] blocks;
+	return result;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+
+/*!
+ * \namespace AtlasCompression AtlasCompression.h
+ * \brief Compression routines for single channel 8-bit font atlases.
+ *
+ * Two independent formats are provided. The LZ routines produce an LZ4 compatible
+ * block (no frame header) and are lossless, meant for the CPU side or on-disk copy
+ * of the atlas. The RGTC1 routines produce BC4 blocks that can be uploaded directly
+ * with GL_COMPRESSED_RED_RGTC1; they are lossy, so compare() is provided to measure
+ * the error against the uncompressed bitmap.
+ */
+namespace AtlasCompression
+{
+	///Worst case size of an LZ block for the given input size
+	std::size_t lzBound(std::size_t size);
+
+	///Compress a buffer into an LZ4 compatible block
+	/*!
+	 * \param[in] src The data to compress
+	 * \param[in] size Size of src in bytes
+	 * \param[out] dst Destination of the block, at least lzBound(size) bytes
+	 * \param[in] capacity Size of dst in bytes
+	 * \return The size of the block, or 0 if dst was too small
+	 */
+	std::size_t lzCompress(const unsigned char *src, std::size_t size, unsigned char *dst, std::size_t capacity);
+
+	///Decompress an LZ4 compatible block
+	/*!
+	 * \param[in] src The compressed block
+	 * \param[in] size Size of the block in bytes
+	 * \param[out] dst Destination of the decompressed data
+	 * \param[in] capacity Size of dst in bytes, should be the exact original size
+	 * \return true if the block was well formed and decompressed to exactly capacity bytes
+	 */
+	bool lzDecompress(const unsigned char *src, std::size_t size, unsigned char *dst, std::size_t capacity);
+
+	///Size of the RGTC1 encoding of a width by height bitmap
+	/*!
+	 * Eight bytes for every 4x4 block, dimensions are rounded up to a multiple of 4.
+	 */
+	std::size_t rgtc1Size(int width, int height);
+
+	///Encode a bitmap into RGTC1 (BC4 unsigned) blocks
+	/*!
+	 * Blocks are emitted row by row starting with the first row of the bitmap,
+	 * matching the row order used by the uncompressed upload.
+	 * Both block modes are tried and the one with the lowest squared error is kept;
+	 * the mode with explicit 0 and 255 usually wins on glyph edges.
+	 * \param[in] bitmap width * height bytes, tightly packed
+	 * \param[out] blocks Destination, at least rgtc1Size(width, height) bytes
+	 */
+	void rgtc1Encode(const unsigned char *bitmap, int width, int height, unsigned char *blocks);
+
+	///Decode RGTC1 blocks back into a tightly packed width * height bitmap
+	void rgtc1Decode(const unsigned char *blocks, int width, int height, unsigned char *bitmap);
+
+	/*!
+	 * \struct AtlasCompression::Accuracy AtlasCompression.h
+	 * \brief Error of a lossy bitmap against the original.
+	 */
+	struct Accuracy
+	{
+		int maxError; ///< Largest absolute difference of a single texel
+		double meanError; ///< Mean absolute difference
+		double psnr; ///< Peak signal to noise ratio in dB, infinite when identical
+		std::size_t changed; ///< Number of texels that differ
+	};
+
+	///Compare two bitmaps of the same size
+	Accuracy compare(const unsigned char *original, const unsigned char *decoded, std::size_t size);
+
+	///Encode a bitmap to RGTC1, decode it again and compare it with the original
+	Accuracy rgtc1Accuracy(const unsigned char *bitmap, int width, int height);
+}
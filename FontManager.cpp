@@ -1,24 +1,43 @@
 #include "FontManager.h"
+#include "AtlasCompression.h"
 #include <algorithm>
 #include <memory>
 #include <iostream>
 
-FontManager::FontManager(FT_Library ftlib, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast)
-	: charinf{ nullptr }, map{ nullptr }, rangeBegin{ charbase }, rangeEnd{ charpast }, bitmap{nullptr}
+FontManager::FontManager(FT_Library ftlib, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast, unsigned phaseCount)
+	: ftSize{ nullptr }, ownsFace{ true }, charinf{ nullptr }, map{ nullptr }, rangeBegin{ charbase }, rangeEnd{ charpast }, phases{ phaseCount ? phaseCount : 1 }, bitmap{nullptr}, packed{ nullptr }, packedSize{ 0 }
 {
 	if(FT_New_Face(ftlib, fontpath, 0, &face)) {
 		//ERROR
 	}
 	
 	FT_Set_Pixel_Sizes(face, fontWidth, fontHeight);
+	ftSize = face->size;
+}
+
+FontManager::FontManager(FontRegistry &registry, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast, unsigned phaseCount)
+	: face{ registry.face(fontpath) }, ftSize{ nullptr }, ownsFace{ false }, charinf{ nullptr }, map{ nullptr }, rangeBegin{ charbase }, rangeEnd{ charpast }, phases{ phaseCount ? phaseCount : 1 }, bitmap{nullptr}, packed{ nullptr }, packedSize{ 0 }
+{
+	if(!face || FT_New_Size(face, &ftSize)) {
+		//ERROR
+		ftSize = nullptr;
+		return;
+	}
+	
+	FT_Activate_Size(ftSize);
+	FT_Set_Pixel_Sizes(face, fontWidth, fontHeight);
 }
 
 FontManager::~FontManager()
 {
-	FT_Done_Face(face);
+	if(ownsFace)
+		FT_Done_Face(face);
+	else if(ftSize)
+		FT_Done_Size(ftSize); //The face is closed by the registry
 	if(charinf) delete[] charinf;
 	if(map) delete[] map;
 	if(bitmap) delete[] bitmap;
+	if(packed) delete[] packed;
 }
 
 void FontManager::bakeTextureAtlas()
@@ -26,15 +45,17 @@ void FontManager::bakeTextureAtlas()
 	int atlas_width = 128;
 	int atlas_height = 128;
 	
-	charinf = new CharInfo[rangeEnd - rangeBegin];
-	map = new AtlasMap[rangeEnd - rangeBegin];
+	FT_Activate_Size(ftSize); //Another manager may share the face at a different size
 	
-	Metric *metrics = new Metric[rangeEnd - rangeBegin];
+	charinf = new CharInfo[glyphCount()];
+	map = new AtlasMap[glyphCount()];
+	
+	Metric *metrics = new Metric[glyphCount()];
 
 	generateMetrics(metrics);
 	
 	//Reversed comparison for descending order
-	std::sort(metrics, &metrics[rangeEnd - rangeBegin], [](const Metric &a, const Metric &b){ return a.area > b.area; });
+	std::sort(metrics, &metrics[glyphCount()], [](const Metric &a, const Metric &b){ return a.area > b.area; });
 	
 	/*std::cout << "Sorted order: ";
 	for(Metric *m = metrics; m < metrics + (rangeEnd - rangeBegin); m++)
@@ -80,11 +101,79 @@ unsigned FontManager::charpast() const
 	return rangeEnd;
 }
 
+unsigned FontManager::subpixelPhases() const
+{
+	return phases;
+}
+
+unsigned FontManager::glyphIndex(unsigned code, unsigned phase) const
+{
+	return (code - rangeBegin) * phases + phase;
+}
+
+unsigned FontManager::glyphCount() const
+{
+	return (rangeEnd - rangeBegin) * phases;
+}
+
 const unsigned char* FontManager::raw() const
 {
 	return bitmap;
 }
 
+bool FontManager::compressBitmap()
+{
+	if(!bitmap)
+		return false;
+	
+	std::size_t size = static_cast<std::size_t>(width) * height;
+	std::size_t bound = AtlasCompression::lzBound(size);
+	unsigned char *scratch = new unsigned char[bound];
+	
+	packedSize = AtlasCompression::lzCompress(bitmap, size, scratch, bound);
+	packed = new unsigned char[packedSize];
+	std::copy(scratch, scratch + packedSize, packed);
+	
+	delete[] scratch;
+	delete[] bitmap;
+	bitmap = nullptr;
+	
+	return true;
+}
+
+void FontManager::releaseBitmap()
+{
+	if(bitmap) delete[] bitmap;
+	if(packed) delete[] packed;
+	bitmap = nullptr;
+	packed = nullptr;
+	packedSize = 0;
+}
+
+bool FontManager::unpackBitmap(unsigned char *out) const
+{
+	std::size_t size = static_cast<std::size_t>(width) * height;
+	
+	if(bitmap)
+	{
+		std::copy(bitmap, bitmap + size, out);
+		return true;
+	}
+	
+	if(packed)
+		return AtlasCompression::lzDecompress(packed, packedSize, out, size);
+	
+	return false;
+}
+
+std::size_t FontManager::bitmapBytes() const
+{
+	if(bitmap)
+		return static_cast<std::size_t>(width) * height;
+	
+	return packedSize;
+}
+
 const FontManager::CharInfo* FontManager::characterInfo() const
 {
 	return charinf;
@@ -105,13 +194,31 @@ int FontManager::mapHeight() const
 	return height;
 }
 
+bool FontManager::renderGlyph(unsigned code, unsigned phase)
+{
+	if(phases == 1)
+		return FT_Load_Char(face, code, FT_LOAD_RENDER) == 0;
+	
+	//Hinting would snap the shifted outline back onto the pixel grid, only hint vertically
+	if(FT_Load_Char(face, code, FT_LOAD_TARGET_LIGHT))
+		return false;
+	
+	FT_GlyphSlot g = face->glyph;
+	
+	if(g->format == FT_GLYPH_FORMAT_OUTLINE)
+		FT_Outline_Translate(&g->outline, (phase * 64) / phases, 0);
+	
+	return FT_Render_Glyph(g, FT_RENDER_MODE_LIGHT) == 0;
+}
+
 void FontManager::generateMetrics(Metric *metrics)
 {
 	FT_GlyphSlot g = face->glyph;
 	
-	for(int fc = rangeBegin; fc < rangeEnd; fc++) {
-		int index = fc - rangeBegin;
-		if(FT_Load_Char(face, fc, FT_LOAD_RENDER))
+	for(int fc = rangeBegin; fc < rangeEnd; fc++)
+	for(unsigned phase = 0; phase < phases; phase++) {
+		int index = glyphIndex(fc, phase);
+		if(!renderGlyph(fc, phase))
 		{
 			std::cerr << "Glyph metric load error" << std::endl;
 			continue; //Exception instead
@@ -119,7 +226,8 @@ void FontManager::generateMetrics(Metric *metrics)
 		
 		CharInfo *record = (charinf + index);
 		
-		record->ax = g->advance.x;
+		//Fractional pen positions need the unrounded advance, 16.16 to 26.6
+		record->ax = phases == 1 ? g->advance.x : g->linearHoriAdvance >> 10;
 		record->ay = g->advance.y;
 		record->bw = g->bitmap.width;
 		record->bh = g->bitmap.rows;
@@ -128,6 +236,7 @@ void FontManager::generateMetrics(Metric *metrics)
 
 		metrics[index].area = record->bw * record->bh;
 		metrics[index].code = fc;
+		metrics[index].phase = phase;
 		
 		/*std::cout << '\'' << static_cast<char>(fc) << '\'' << ':' << std::endl;
 		std::cout << "\tAdvance x: " << record->ax << " Advance y: " << record->ay << std::endl
@@ -142,14 +251,14 @@ bool FontManager::pack(Metric *metrics, int atlas_width, int atlas_height)
 	FT_GlyphSlot g = face->glyph;
 	unsigned writeX = 0; //Current horizontal position
 	unsigned writeY = 0; //Current vertical position
-	unsigned rowHeight = charinf[metrics[0].code - rangeBegin].bh; 
+	unsigned rowHeight = charinf[glyphIndex(metrics[0].code, metrics[0].phase)].bh; 
 	int m = 0;
 	
-	for(m = 0; m < (rangeEnd - rangeBegin); m++)
+	for(m = 0; m < glyphCount(); m++)
 	{
-		int index = metrics[m].code - rangeBegin;
+		int index = glyphIndex(metrics[m].code, metrics[m].phase);
 		
-		if(FT_Load_Char(face, metrics[m].code, FT_LOAD_RENDER))
+		if(!renderGlyph(metrics[m].code, metrics[m].phase))
 		{
 			std::cerr << "Glyph copy load error" << std::endl;
 			continue; //Exception instead
@@ -188,7 +297,7 @@ bool FontManager::pack(Metric *metrics, int atlas_width, int atlas_height)
 		writeX += charinf[index].bw;
 	}
 	
-	if(m == (rangeEnd - rangeBegin))
+	if(m == glyphCount())
 	{
 		//std::cout << "Atlas size: " << atlas_width << "x" << atlas_height << std::endl;
 		return true;
@@ -1,7 +1,11 @@
 #pragma once
+#include <cstddef>
 #include "ft2build.h"
 #include FT_FREETYPE_H
 #include FT_OUTLINE_H
+#include FT_SIZES_H
+
+#include "FontRegistry.h"
 
 /*!
  * \class FontManager FontManager.h
@@ -21,14 +25,28 @@ public:
 	 * \param[in] fontHeight The font size's height for this manager.
 	 * \param[in] charbase the code point at which to start the atlas, inclusive
 	 * \param[in] charpast the code point at which to end the atlas, exclusive
+	 * \param[in] phaseCount number of horizontal subpixel positions baked per glyph, 1 disables subpixel positioning
+	 */
+	FontManager(FT_Library ftlib, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast, unsigned phaseCount = 1);
+	
+	///Constructor that shares a face loaded by a registry
+	/*!
+	 * The font file is read and parsed once per registry; this manager only adds
+	 * an FT_Size for its pixel size to the shared face, activated while baking.
+	 * \param[in] registry The registry owning the face, must outlive the manager
+	 * \param[in] fontpath A file path to the font, loaded by the registry on first use
+	 *
+	 * The other parameters are the same as for the constructor above.
 	 */
-	FontManager(FT_Library ftlib, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast);
+	FontManager(FontRegistry &registry, const char *fontpath, unsigned fontWidth, unsigned fontHeight, unsigned charbase, unsigned charpast, unsigned phaseCount = 1);
 	
 	~FontManager();
 	
 	///Creates the texture atlas from characters in rangeBegin to rangeEnd
 	/*!
 	 * Greedy packing, begins by attempting a 128x128, and doubles size until every character fits.
+	 * When more than one subpixel phase is requested, every phase of every character is
+	 * rendered with its outline shifted right by phase / phases of a pixel and packed separately.
 	 */
 	void bakeTextureAtlas();
 	
@@ -46,21 +64,76 @@ public:
 	 */
 	unsigned charpast() const;
 	
+	///Get the number of horizontal subpixel phases baked per code point
+	/*!
+	 *
+	 * \return The number of phases, 1 if subpixel positioning is disabled
+	 */
+	unsigned subpixelPhases() const;
+	
+	///Get the index of a glyph variant in characterInfo() and atlasMap()
+	/*!
+	 * Variants of one code point are stored next to each other, phase 0 first.
+	 * \param[in] code The code point, must be in [charbase, charpast)
+	 * \param[in] phase The subpixel phase, must be less than subpixelPhases()
+	 * \return (code - charbase) * subpixelPhases() + phase
+	 */
+	unsigned glyphIndex(unsigned code, unsigned phase) const;
+	
+	///Get the number of glyph variants in the atlas
+	/*!
+	 *
+	 * \return (charpast - charbase) * subpixelPhases()
+	 */
+	unsigned glyphCount() const;
+	
 	///Get a pointer to the raw bitmap data
 	/*!
 	*
-	* \return Const unsigned char pointer to bitmap data
+	* \return Const unsigned char pointer to bitmap data, nullptr after compressBitmap() or releaseBitmap()
 	*/
 	const unsigned char* raw() const;
 	
+	///Replace the raw bitmap with a lossless LZ compressed copy
+	/*!
+	 * The raw bitmap is freed, raw() returns nullptr afterwards and
+	 * unpackBitmap() must be used to read the atlas again.
+	 * \return true if the bitmap was compressed, false if there was no raw bitmap
+	 */
+	bool compressBitmap();
+	
+	///Free the CPU copy of the atlas, raw or compressed
+	/*!
+	 * The glyph metrics and atlas map are kept, but the atlas can no longer be uploaded.
+	 * This ties the manager to the FontResources that exist when it is called: once the
+	 * last backend of a share group and format is destroyed, FontResource::acquire()
+	 * returns nullptr for it. Only release the atlas when no window, share group or
+	 * atlas format will be added later; otherwise keep the compressBitmap() copy.
+	 */
+	void releaseBitmap();
+	
+	///Copy the atlas, decompressing it if necessary
+	/*!
+	 * \param[out] out Destination of mapWidth() * mapHeight() bytes
+	 * \return true if a CPU copy of the atlas was available
+	 */
+	bool unpackBitmap(unsigned char *out) const;
+	
+	///Get the number of bytes used by the CPU copy of the atlas
+	/*!
+	 *
+	 * \return Size of the raw or compressed bitmap, 0 once released
+	 */
+	std::size_t bitmapBytes() const;
+	
 	/*!
 	 * \struct FontManager::CharInfo FontManager.h
 	 * \brief Encapsulates information necessary to render each glyph
 	 */
 	struct CharInfo
 	{
-		int ax; ///< X advance
-		int ay; ///< Y advance
+		int ax; ///< X advance in 26.6, unhinted when subpixel phases are baked
+		int ay; ///< Y advance in 26.6
 
 		unsigned bw; ///< Bitmap width
 		unsigned bh; ///< Bitmap rows
@@ -89,10 +162,15 @@ public:
 	
 private:
 	FT_Face face; ///< FreeType handle for the font
+	FT_Size ftSize; ///< Scale of this manager, the face's own size unless the face is shared
+	bool ownsFace; ///< false when the face belongs to a FontRegistry
 	CharInfo *charinf;
 	AtlasMap *map;
 	unsigned rangeBegin, rangeEnd;
+	unsigned phases; ///< Horizontal subpixel phases per code point
 	unsigned char *bitmap;
+	unsigned char *packed; ///< LZ compressed bitmap, only set after compressBitmap()
+	std::size_t packedSize;
 	int width;
 	int height;
 	
@@ -106,8 +184,11 @@ private:
 	{
 		unsigned area;
 		unsigned code;
+		unsigned phase;
 	};
 	
+	///Load and render a glyph into the face's glyph slot, shifted right by phase / phases of a pixel
+	bool renderGlyph(unsigned code, unsigned phase);
 	void generateMetrics(Metric *metrics);
 	bool pack(Metric *metrics, int atlas_width, int atlas_height);
 };
\ No newline at end of file
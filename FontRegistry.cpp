@@ -0,0 +1,54 @@
+#include "FontRegistry.h"
+#include <fstream>
+
+FontRegistry::FontRegistry(FT_Library ftlib) : library{ ftlib }
+{
+}
+
+FontRegistry::~FontRegistry()
+{
+	for(auto &entry : fonts)
+	{
+		FT_Done_Face(entry.second.face);
+		delete[] entry.second.data;
+	}
+}
+
+FT_Face FontRegistry::face(const char *fontpath)
+{
+	auto found = fonts.find(fontpath);
+	if(found != fonts.end())
+		return found->second.face;
+
+	std::ifstream file{ fontpath, std::ios::binary | std::ios::ate };
+	if(!file)
+		return nullptr;
+
+	std::size_t size = static_cast<std::size_t>(file.tellg());
+	unsigned char *data = new unsigned char[size];
+	file.seekg(0);
+
+	FT_Face face;
+	if(!file.read(reinterpret_cast<char*>(data), size) ||
+		FT_New_Memory_Face(library, data, static_cast<FT_Long>(size), 0, &face))
+	{
+		delete[] data;
+		return nullptr;
+	}
+
+	fonts[fontpath] = Font{ data, size, face };
+	return face;
+}
+
+std::size_t FontRegistry::faceCount() const
+{
+	return fonts.size();
+}
+
+std::size_t FontRegistry::fileBytes() const
+{
+	std::size_t bytes = 0;
+	for(auto &entry : fonts)
+		bytes += entry.second.size;
+	return bytes;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <string>
+#include "ft2build.h"
+#include FT_FREETYPE_H
+
+/*!
+ * \class FontRegistry FontRegistry.h
+ * \brief Loads each font file once and shares its face between FontManagers.
+ *
+ * The file is read into memory on first use and opened with FT_New_Memory_Face,
+ * so baking one font at several sizes reads and parses the file once. Every
+ * FontManager created from a registry adds its own FT_Size to the shared face.
+ * Managers sharing a face must not bake at the same time, and must be destroyed
+ * before the registry.
+ */
+class FontRegistry
+{
+public:
+	///Create an empty registry
+	/*!
+	 * \param[in] ftlib The FreeType library handle to open faces with, must outlive the registry
+	 */
+	explicit FontRegistry(FT_Library ftlib);
+
+	///Close every face and free the file contents
+	~FontRegistry();
+
+	FontRegistry(const FontRegistry&) = delete;
+	FontRegistry& operator=(const FontRegistry&) = delete;
+
+	///Get the face of a font file, loading the file on first use
+	/*!
+	 * \param[in] fontpath A file path to the font, files are identified by this string
+	 * \return The shared face, nullptr if the file could not be read or parsed
+	 */
+	FT_Face face(const char *fontpath);
+
+	///Number of faces open
+	std::size_t faceCount() const;
+
+	///Bytes of font files held in memory
+	std::size_t fileBytes() const;
+
+private:
+	/*!
+	 * \struct FontRegistry::Font FontRegistry.h
+	 * \brief A font file in memory and the face reading from it.
+	 */
+	struct Font
+	{
+		unsigned char *data; ///< File contents, must stay valid while the face is open
+		std::size_t size;
+		FT_Face face;
+	};
+
+	FT_Library library;
+	std::map<std::string, Font> fonts;
+};
@@ -0,0 +1,187 @@
+#include "FontResource.h"
+#include "AtlasCompression.h"
+
+#ifdef _DEBUG
+#include <iostream>
+#endif
+
+std::shared_ptr<FontResource> FontResource::acquire(const FontManager &mgr, AtlasFormat format, const void *shareGroup)
+{
+	const Key key{ &mgr, shareGroup, format };
+	std::lock_guard<std::mutex> guard{ registryLock() };
+
+	std::weak_ptr<FontResource> &entry = registry()[key];
+	std::shared_ptr<FontResource> resource = entry.lock();
+
+	if(!resource)
+	{
+		if(mgr.bitmapBytes() == 0)
+			return nullptr; //The atlas was released, there is nothing to upload
+		
+		resource.reset(new FontResource{ mgr, format, key }); //Constructor is private, so no make_shared
+		entry = resource;
+	}
+
+	return resource;
+}
+
+FontResource::FontResource(const FontManager &mgr, AtlasFormat format, const Key &k) :
+	fontManager{ mgr }, key{ k }, atlasFormat{ format }, range{ mgr.glyphCount() },
+	texture{ GL_TEXTURE_2D, 1, static_cast<GLenum>(format == AtlasFormat::RGTC1 ? GL_COMPRESSED_RED_RGTC1 : GL_R8UI), mgr.mapWidth(), mgr.mapHeight(), 0 }
+{
+	glCreateBuffers(1, &ssbo);
+	glNamedBufferStorage(ssbo, META_BYTES * range, NULL, GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
+	loadMetaInfo();
+
+	loadAtlas();
+	//Change to glwrap::Sampler
+	//Integer textures are incomplete with the default linear filters, strict drivers (llvmpipe) sample zero
+	glTextureParameteri(texture.id(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(texture.id(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(texture.id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture.id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+FontResource::~FontResource()
+{
+	glDeleteBuffers(1, &ssbo);
+
+	std::lock_guard<std::mutex> guard{ registryLock() };
+	auto it = registry().find(key);
+	if(it != registry().end() && it->second.expired()) //Another thread may already have replaced the entry
+		registry().erase(it);
+}
+
+void FontResource::bind() const
+{
+	texture.bind(0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+}
+
+GLuint FontResource::metaBuffer() const
+{
+	return ssbo;
+}
+
+FontResource::AtlasFormat FontResource::format() const
+{
+	return atlasFormat;
+}
+
+const FontManager& FontResource::manager() const
+{
+	return fontManager;
+}
+
+std::size_t FontResource::liveCount()
+{
+	std::lock_guard<std::mutex> guard{ registryLock() };
+	std::size_t live = 0;
+	for(auto &entry : registry())
+		if(!entry.second.expired())
+			live++;
+	return live;
+}
+
+#ifdef _DEBUG
+void FontResource::printSSBO() const
+{
+	unsigned char *base = static_cast<unsigned char*>(glMapNamedBufferRange(ssbo, 0, META_BYTES * range, GL_MAP_READ_BIT));
+	unsigned char *ptr = base;
+
+	for (unsigned u = 0; u < range; u++)
+	{
+		std::cout << static_cast<void*>(ptr) << ": '" << static_cast<char>(u / fontManager.subpixelPhases() + fontManager.charbase())
+			<< "' Phase: " << u % fontManager.subpixelPhases() << std::endl;
+		std::cout << "\tAdvance X: " << *reinterpret_cast<int*>(ptr)
+			<< " Advance Y: " << *reinterpret_cast<int*>(ptr + 4) << std::endl;
+		std::cout << "\tBitmap Width: " << *reinterpret_cast<unsigned*>(ptr + 8)
+			<< " Bitmap Height: " << *reinterpret_cast<unsigned*>(ptr + 12) << std::endl;
+		std::cout << "\tLeft Bearing: " << *reinterpret_cast<int*>(ptr + 16)
+			<< " Top Bearing: " << *reinterpret_cast<int*>(ptr + 20) << std::endl;
+
+		std::cout << "\tTexel Base X: " << *reinterpret_cast<int*>(ptr + 24)
+			<< " Texel Base Y: " << *reinterpret_cast<int*>(ptr + 28) << std::endl;
+
+		ptr += META_BYTES;
+	}
+
+	glUnmapNamedBuffer(ssbo);
+}
+#endif
+
+std::map<FontResource::Key, std::weak_ptr<FontResource>>& FontResource::registry()
+{
+	static std::map<Key, std::weak_ptr<FontResource>> resources;
+	return resources;
+}
+
+std::mutex& FontResource::registryLock()
+{
+	static std::mutex lock;
+	return lock;
+}
+
+void FontResource::loadMetaInfo()
+{
+	const FontManager::CharInfo *info = fontManager.characterInfo();
+	const FontManager::AtlasMap *map = fontManager.atlasMap();
+
+	unsigned char *buffer = static_cast<unsigned char*>(glMapNamedBufferRange(ssbo, 0, META_BYTES * range, GL_MAP_WRITE_BIT));
+
+	for(unsigned u = 0; u < range; u++)
+	{
+		*reinterpret_cast<int*>(buffer) = info[u].ax;
+		*reinterpret_cast<int*>(buffer + 4) = info[u].ay;
+		*reinterpret_cast<unsigned*>(buffer + 8) = info[u].bw;
+		*reinterpret_cast<unsigned*>(buffer + 12) = info[u].bh;
+		*reinterpret_cast<int*>(buffer + 16) = info[u].lb;
+		*reinterpret_cast<int*>(buffer + 20) = info[u].tb;
+
+		*reinterpret_cast<int*>(buffer + 24) = map[u].lx; //X base
+		*reinterpret_cast<int*>(buffer + 28) = map[u].hy; //Y base, high becomes low when flipped
+		/*
+			*reinterpret_cast<float*>(buffer + 24) = static_cast<float>(map[u].lx) / fontManager.mapWidth();
+			*reinterpret_cast<float*>(buffer + 28) = static_cast<float>(map[u].hx) / fontManager.mapWidth();
+			*reinterpret_cast<float*>(buffer + 32) = static_cast<float>(fontManager.mapHeight() - map[u].hy) / fontManager.mapHeight();
+			*reinterpret_cast<float*>(buffer + 36) = static_cast<float>(fontManager.mapHeight() - map[u].lx) / fontManager.mapHeight();
+		*/
+		buffer += META_BYTES;
+	}
+
+	glUnmapNamedBuffer(ssbo);
+}
+
+void FontResource::loadAtlas()
+{
+	const int width = fontManager.mapWidth();
+	const int height = fontManager.mapHeight();
+	const unsigned char *bitmap = fontManager.raw();
+	unsigned char *unpacked = nullptr;
+
+	if(!bitmap)
+	{
+		unpacked = new unsigned char[static_cast<std::size_t>(width) * height];
+		if(!fontManager.unpackBitmap(unpacked))
+		{
+			delete[] unpacked;
+			return; //Corrupt compressed copy, acquire() already refused a released atlas
+		}
+		bitmap = unpacked;
+	}
+
+	if(atlasFormat == AtlasFormat::RGTC1)
+	{
+		std::size_t size = AtlasCompression::rgtc1Size(width, height);
+		unsigned char *blocks = new unsigned char[size];
+		AtlasCompression::rgtc1Encode(bitmap, width, height, blocks);
+		glCompressedTextureSubImage2D(texture.id(), 0, 0, 0, width, height, GL_COMPRESSED_RED_RGTC1, static_cast<GLsizei>(size), blocks);
+		delete[] blocks;
+	}
+	else
+	{
+		texture.store(0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, bitmap);
+	}
+
+	if(unpacked) delete[] unpacked;
+}
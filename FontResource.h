@@ -0,0 +1,93 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "FontManager.h"
+#include "Texture.h"
+#include "GL/glew.h"
+
+/*!
+ * \class FontResource FontResource.h
+ * \brief GPU copy of a baked font: the atlas texture and the glyph SSBO.
+ *
+ * Resources are shared. acquire() returns the existing resource of a FontManager in
+ * a share group if there is one and uploads a new one otherwise, so any number of
+ * GLBackend instances (one per window or layer) cost one texture and one SSBO per
+ * font. The resource is destroyed with its last reference, which must be released
+ * while a context of its share group is current.
+ */
+class FontResource
+{
+public:
+	///GPU storage of the texture atlas
+	enum class AtlasFormat
+	{
+		Integer, ///< GL_R8UI, sampled with texelFetch on a usampler2D (text_fs.glsl)
+		RGTC1 ///< GL_COMPRESSED_RED_RGTC1, a quarter of the memory, normalized sampling (text_fs_unorm.glsl)
+	};
+
+	///Get the resource of a manager, uploading it on first use
+	/*!
+	 * The atlas is read through FontManager::unpackBitmap(), so the manager may hold
+	 * a compressed copy. Once the resources of a manager are acquired, the CPU copy
+	 * can be freed with FontManager::releaseBitmap(), after which only the resources
+	 * that still exist can be returned.
+	 * \param[in] mgr A baked FontManager, must outlive the resource
+	 * \param[in] format Texture format of the atlas, resources of different formats are not shared
+	 * \param[in] shareGroup Any pointer identifying the contexts that share objects with the current one,
+	 * e.g. the first context or window created in the group; nullptr when there is a single group
+	 * \return The shared resource, nullptr if none exists and the manager's atlas was released
+	 */
+	static std::shared_ptr<FontResource> acquire(const FontManager &mgr, AtlasFormat format = AtlasFormat::Integer, const void *shareGroup = nullptr);
+
+	~FontResource();
+
+	FontResource(const FontResource&) = delete;
+	FontResource& operator=(const FontResource&) = delete;
+
+	///Bind the atlas to texture unit 0 and the SSBO to binding point 0
+	void bind() const;
+
+	///SSBO holding one Meta structure per glyph variant
+	GLuint metaBuffer() const;
+
+	AtlasFormat format() const;
+
+	const FontManager& manager() const;
+
+	///Number of resources alive in every share group
+	static std::size_t liveCount();
+#ifdef _DEBUG
+	void printSSBO() const;
+#endif
+
+private:
+	typedef std::tuple<const FontManager*, const void*, AtlasFormat> Key;
+
+	static constexpr std::size_t META_BYTES = 32; ///< Meta structure size in shader
+	const FontManager &fontManager;
+	const Key key;
+	const AtlasFormat atlasFormat;
+	const unsigned range; ///< Glyph variants in the SSBO
+	glwrap::Texture texture;
+	GLuint ssbo;
+
+	FontResource(const FontManager &mgr, AtlasFormat format, const Key &k);
+
+	///Resources by manager, share group and format; expired entries are erased by the destructor
+	static std::map<Key, std::weak_ptr<FontResource>>& registry();
+
+	static std::mutex& registryLock();
+
+	///Fill out the SSBO in the vertex shader with the details for each glyph
+	void loadMetaInfo();
+
+	///Upload the manager's atlas into FontResource::texture
+	/*!
+	 * RGTC1 blocks are encoded on the CPU from the uncompressed bitmap.
+	 */
+	void loadAtlas();
+};
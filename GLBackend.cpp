@@ -0,0 +1,291 @@
+#include "GLBackend.h"
+#include <algorithm>
+#include <cassert>
+
+#ifdef _DEBUG
+#include <iostream>
+#endif
+
+GLBackend::GLBackend(const FontManager &mgr, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity, AtlasFormat format) :
+	GLBackend{ FontResource::acquire(mgr, format), prg, width, height, initCapacity }
+{
+}
+
+GLBackend::GLBackend(std::shared_ptr<FontResource> fnt, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity) :
+	scX{ width }, scY{ height },
+	font{ requireResource(std::move(fnt)) }, manager{ font->manager() }, program{ prg },
+	layoutProgram{ nullptr }, codeBuffer{ 0 }, runBuffer{ 0 }, codeCapacity{ 0 }, runCapacity{ 0 }, codesMapped{ false },
+	vertexCapacity{ initCapacity }, staticBound{ false },
+	orthographic{ glm::ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height)) },
+	timers{}, timerIssued{}, timerSlot{ 0 }, gpuTime{ -1.0 }
+{
+	glCreateBuffers(1, &vbo);
+	glNamedBufferStorage(vbo, VERTEX_BYTES * vertexCapacity, NULL, GL_MAP_WRITE_BIT);
+	vao = createVertexArray(vbo);
+	staticVao = createVertexArray(0);
+	glBindVertexArray(vao);
+	
+	glShaderStorageBlockBinding(program.id(), 0, 0);
+}
+
+GLBackend::~GLBackend()
+{
+	if(codeBuffer) glDeleteBuffers(1, &codeBuffer);
+	if(runBuffer) glDeleteBuffers(1, &runBuffer);
+	enableGpuTimer(false);
+	glDeleteBuffers(1, &vbo);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &staticVao);
+}
+
+std::shared_ptr<FontResource> GLBackend::requireResource(std::shared_ptr<FontResource> fnt)
+{
+	assert(fnt && "No font resource, the manager's atlas was released before it could be uploaded");
+	return fnt;
+}
+
+GLuint GLBackend::createVertexArray(GLuint buffer)
+{
+	GLuint array;
+	glCreateVertexArrays(1, &array);
+	glVertexArrayVertexBuffer(array, 0, buffer, 0, VERTEX_BYTES);
+	
+	glVertexArrayAttribIFormat(array, 0, 2, GL_INT, 0);
+	glVertexArrayAttribFormat(array, 1, 3, GL_FLOAT, GL_FALSE, 8);
+	glVertexArrayAttribIFormat(array, 2, 1, GL_UNSIGNED_INT, 20);
+	
+	glVertexArrayAttribBinding(array, 0, 0); //Origin
+	glVertexArrayAttribBinding(array, 1, 0); //Color
+	glVertexArrayAttribBinding(array, 2, 0); //Map Index
+
+	glEnableVertexArrayAttrib(array, 0);
+	glEnableVertexArrayAttrib(array, 1);
+	glEnableVertexArrayAttrib(array, 2);
+	
+	return array;
+}
+
+void GLBackend::useGpuLayout(const glwrap::Program *compute)
+{
+	layoutProgram = compute;
+}
+
+void GLBackend::enableGpuTimer(bool enable)
+{
+	if(enable == (timers[0] != 0))
+		return;
+	
+	if(enable)
+	{
+		glCreateQueries(GL_TIME_ELAPSED, TIMER_QUERIES, timers);
+	}
+	else
+	{
+		glDeleteQueries(TIMER_QUERIES, timers);
+		std::fill(timers, timers + TIMER_QUERIES, 0);
+	}
+	
+	std::fill(timerIssued, timerIssued + TIMER_QUERIES, false);
+	timerSlot = 0;
+	gpuTime = -1.0;
+}
+
+bool GLBackend::reserve(unsigned glyphs)
+{
+	if(glyphs <= vertexCapacity)
+		return false;
+	
+	unsigned old_capacity = vertexCapacity;
+	vertexCapacity = grow(vertexCapacity, glyphs);
+	
+	GLuint swap;
+	glCreateBuffers(1, &swap);
+	glNamedBufferStorage(swap, VERTEX_BYTES * vertexCapacity, NULL, GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
+	glCopyNamedBufferSubData(vbo, swap, 0, 0, VERTEX_BYTES * old_capacity);
+	glVertexArrayVertexBuffer(vao, 0, swap, 0, VERTEX_BYTES); //Update binding point with new buffer
+	glDeleteBuffers(1, &vbo);
+	vbo = swap; //Store the new buffer name
+
+	//Add some counter or other mechanism to shrink buffer after a while
+	return true;
+}
+
+unsigned GLBackend::capacity() const
+{
+	return vertexCapacity;
+}
+
+unsigned char* GLBackend::mapVertices(std::size_t offset, std::size_t bytes)
+{
+	return static_cast<unsigned char*>(glMapNamedBufferRange(vbo, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+}
+
+void GLBackend::unmapVertices()
+{
+	glUnmapNamedBuffer(vbo);
+}
+
+bool GLBackend::expandsCodePoints() const
+{
+	return layoutProgram != nullptr;
+}
+
+void GLBackend::mapCodePoints(unsigned firstGlyph, unsigned glyphs, unsigned strings, unsigned char **codes, unsigned char **runs)
+{
+	//Only the dirty range is read by the shader, so neither buffer needs its old contents when grown
+	if(codeCapacity < vertexCapacity)
+	{
+		if(codeBuffer) glDeleteBuffers(1, &codeBuffer);
+		codeCapacity = vertexCapacity;
+		glCreateBuffers(1, &codeBuffer);
+		glNamedBufferStorage(codeBuffer, CODE_BYTES * codeCapacity, NULL, GL_MAP_WRITE_BIT);
+	}
+	
+	if(runCapacity < strings)
+	{
+		if(runBuffer) glDeleteBuffers(1, &runBuffer);
+		runCapacity = grow(runCapacity, strings);
+		glCreateBuffers(1, &runBuffer);
+		glNamedBufferStorage(runBuffer, RUN_BYTES * runCapacity, NULL, GL_MAP_WRITE_BIT);
+	}
+	
+	codesMapped = glyphs != 0; //Mapping an empty range is an error
+	*codes = !codesMapped ? nullptr : static_cast<unsigned char*>(glMapNamedBufferRange(codeBuffer, CODE_BYTES * firstGlyph, CODE_BYTES * glyphs,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+	*runs = static_cast<unsigned char*>(glMapNamedBufferRange(runBuffer, 0, RUN_BYTES * strings,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+}
+
+void GLBackend::expandCodePoints(unsigned strings)
+{
+	if(codesMapped) glUnmapNamedBuffer(codeBuffer);
+	codesMapped = false;
+	glUnmapNamedBuffer(runBuffer);
+	
+	layoutProgram->use();
+	glProgramUniform1ui(layoutProgram->id(), 0, manager.charbase());
+	glProgramUniform1ui(layoutProgram->id(), 1, manager.subpixelPhases());
+	glProgramUniform1ui(layoutProgram->id(), 2, strings);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, font->metaBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, runBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, codeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, vbo);
+	glDispatchCompute((strings + LAYOUT_GROUP - 1) / LAYOUT_GROUP, 1, 1);
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GLBackend::beginFrame()
+{
+	staticBound = false; //The application may have changed the bindings since the last frame
+	
+	if(!timers[0])
+		return;
+	
+	//The slot about to be reused holds the oldest query, collect it if it finished
+	GLuint query = timers[timerSlot];
+	if(timerIssued[timerSlot])
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			gpuTime = elapsed / 1.0e6;
+		}
+	}
+	
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void GLBackend::draw(unsigned glyphs)
+{
+	bindState();
+	glDrawArrays(GL_POINTS, 0, glyphs);
+}
+
+void GLBackend::drawRanges(const int *first, const int *count, unsigned ranges)
+{
+	bindState();
+	glMultiDrawArrays(GL_POINTS, first, count, static_cast<GLsizei>(ranges));
+}
+
+unsigned GLBackend::createStatic(const unsigned char *vertices, unsigned glyphs)
+{
+	GLuint buffer;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, VERTEX_BYTES * glyphs, vertices, 0);
+	return buffer;
+}
+
+void GLBackend::drawStatic(unsigned handle, unsigned glyphs)
+{
+	if(!staticBound)
+	{
+		bindState();
+		glBindVertexArray(staticVao);
+		staticBound = true;
+	}
+	
+	glVertexArrayVertexBuffer(staticVao, 0, handle, 0, VERTEX_BYTES);
+	glDrawArrays(GL_POINTS, 0, glyphs);
+}
+
+void GLBackend::destroyStatic(unsigned handle)
+{
+	GLuint buffer = handle;
+	glDeleteBuffers(1, &buffer);
+}
+
+unsigned GLBackend::endFrame()
+{
+	if(timers[0])
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		timerIssued[timerSlot] = true;
+		timerSlot = (timerSlot + 1) % TIMER_QUERIES;
+	}
+	
+	return glGetError();
+}
+
+bool GLBackend::gpuMilliseconds(double &ms)
+{
+	if(gpuTime < 0.0)
+		return false;
+	
+	ms = gpuTime;
+	return true;
+}
+
+#ifdef _DEBUG
+void GLBackend::printVBO(unsigned glyphs)
+{
+	unsigned char *base = static_cast<unsigned char*>(glMapNamedBufferRange(vbo, 0, VERTEX_BYTES * glyphs, GL_MAP_READ_BIT));
+	unsigned char *ptr = base;
+
+	for (int i = 0; i < glyphs; i++)
+	{
+		unsigned uc = *reinterpret_cast<unsigned*>(ptr + 20) / manager.subpixelPhases() + manager.charbase();
+		std::cout << static_cast<void*>(ptr) << ": '" << static_cast<char>(uc) << '\'' << std::endl;
+		std::cout << "\tOrigin: (" << *reinterpret_cast<int*>(ptr) << ", "
+			<< *reinterpret_cast<int*>(ptr + 4) << ')' << std::endl;
+		std::cout << "\tColor: (" << *reinterpret_cast<float*>(ptr + 8) << ", "
+			<< *reinterpret_cast<float*>(ptr + 12) << ", "
+			<< *reinterpret_cast<float*>(ptr + 16) << ')' << std::endl;
+
+		ptr += VERTEX_BYTES;
+	}
+
+	glUnmapNamedBuffer(vbo);
+}
+#endif
+
+void GLBackend::bindState()
+{
+	program.use();
+	program.setMat4(0, glm::value_ptr(orthographic));
+	font->bind();
+	glBindVertexArray(vao);
+	staticBound = false;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+
+#include "FontManager.h"
+#include "FontResource.h"
+#include "RenderBackend.h"
+#include "Program.h"
+#include "GL/glew.h"
+#include "GLM/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+/*!
+ * \class GLBackend GLBackend.h
+ * \brief OpenGL 4.5 RenderBackend, owns the VBO and VAO and binds a shared FontResource.
+ */
+class GLBackend : public RenderBackend
+{
+public:
+	typedef FontResource::AtlasFormat AtlasFormat;
+
+	///Create the vertex storage, acquiring the font resource of a baked FontManager
+	/*!
+	 * Shorthand for the constructor below with FontResource::acquire(mgr, format).
+	 * The resource must exist or the manager must still hold its atlas, see FontManager::releaseBitmap().
+	 * \param[in] format Texture format of the atlas, the fragment shader in prg must match it
+	 */
+	explicit GLBackend(const FontManager &mgr, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity, AtlasFormat format = AtlasFormat::Integer);
+
+	///Create the vertex storage, drawing with a font resource that may be shared with other backends
+	/*!
+	 * \param[in] font The atlas and glyph SSBO, the backend holds a reference until destroyed; must not be nullptr
+	 */
+	explicit GLBackend(std::shared_ptr<FontResource> font, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity);
+	~GLBackend();
+
+	///Lay out glyphs with a compute shader instead of on the CPU
+	/*!
+	 * In this mode only the code points of changed strings (4 bytes per glyph) and one
+	 * record per changed string (origin, color, first glyph, count) are uploaded.
+	 * The compute shader (text_cs.glsl) looks up each glyph index, accumulates the
+	 * advances from the SSBO and writes the vertex buffer directly.
+	 * Call TextEngine::invalidate() after switching so every string is rewritten by the new path.
+	 * \param[in] compute A linked program containing text_cs.glsl, or nullptr to return to CPU layout.
+	 * The program must outlive the backend or the next call to this function.
+	 */
+	void useGpuLayout(const glwrap::Program *compute);
+
+	///Measure GPU time of each frame with GL_TIME_ELAPSED queries
+	/*!
+	 * Off by default, since only one GL_TIME_ELAPSED query can be active at a time
+	 * and the application may use its own. Results are read without stalling, so
+	 * the reported time lags a few frames behind.
+	 */
+	void enableGpuTimer(bool enable);
+
+	bool reserve(unsigned glyphs) override;
+	unsigned capacity() const override;
+	unsigned char* mapVertices(std::size_t offset, std::size_t bytes) override;
+	void unmapVertices() override;
+	bool expandsCodePoints() const override;
+	void mapCodePoints(unsigned firstGlyph, unsigned glyphs, unsigned strings, unsigned char **codes, unsigned char **runs) override;
+	void expandCodePoints(unsigned strings) override;
+	void beginFrame() override;
+	void draw(unsigned glyphs) override;
+	void drawRanges(const int *first, const int *count, unsigned ranges) override;
+	
+	///Upload vertices into a buffer created with glNamedBufferStorage and no access flags
+	/*!
+	 * The buffer cannot be mapped or updated, so the driver is free to keep it in device memory only.
+	 * \return The buffer name
+	 */
+	unsigned createStatic(const unsigned char *vertices, unsigned glyphs) override;
+	void drawStatic(unsigned handle, unsigned glyphs) override;
+	void destroyStatic(unsigned handle) override;
+	unsigned endFrame() override;
+	bool gpuMilliseconds(double &ms) override;
+#ifdef _DEBUG
+	void printVBO(unsigned glyphs);
+#endif
+
+private:
+	static constexpr unsigned LAYOUT_GROUP = 64; ///< Local size of the layout shader
+	static constexpr unsigned TIMER_QUERIES = 4; ///< Frames a timer query may be in flight
+	const unsigned scX, scY; ///< Screen dimensions
+	const std::shared_ptr<FontResource> font;
+	const FontManager &manager;
+	const glwrap::Program &program;
+	GLuint vbo, vao; ///< Names for the VBO and VAO used in the backend
+	GLuint staticVao; ///< Same format as vao, its buffer binding is switched to each static buffer
+	const glwrap::Program *layoutProgram; ///< Compute program for GPU layout, nullptr for CPU layout
+	GLuint codeBuffer, runBuffer; ///< Code points and string records read by the layout shader
+	unsigned codeCapacity, runCapacity;
+	bool codesMapped;
+	unsigned vertexCapacity;
+	bool staticBound; ///< State for drawStatic() is bound, only the buffer of staticVao changes between blocks
+	glm::mat4 orthographic;
+	GLuint timers[TIMER_QUERIES]; ///< Ring of GL_TIME_ELAPSED queries, 0 when disabled
+	bool timerIssued[TIMER_QUERIES];
+	unsigned timerSlot;
+	double gpuTime; ///< Most recent timer result in milliseconds, negative if none yet
+
+	///Use the program and bind the font resource and VAO for drawing
+	void bindState();
+	
+	///Assert that FontResource::acquire() found or created a resource
+	static std::shared_ptr<FontResource> requireResource(std::shared_ptr<FontResource> fnt);
+	
+	///Create a VAO with the glyph vertex format, reading binding point 0
+	static GLuint createVertexArray(GLuint buffer);
+};
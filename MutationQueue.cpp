@@ -0,0 +1,63 @@
+#include "MutationQueue.h"
+
+MutationQueue::MutationQueue() : head{ &stub }, tail{ &stub }
+{
+	stub.next.store(nullptr, std::memory_order_relaxed);
+}
+
+MutationQueue::~MutationQueue()
+{
+	while(Command *c = pop())
+		delete c;
+}
+
+void MutationQueue::push(Command *c)
+{
+	c->next.store(nullptr, std::memory_order_relaxed);
+	Command *prev = head.exchange(c, std::memory_order_acq_rel);
+	//Between the exchange and this store the node is unreachable from tail; pop() sees the gap as empty
+	prev->next.store(c, std::memory_order_release);
+}
+
+MutationQueue::Command* MutationQueue::pop()
+{
+	Command *t = tail;
+	Command *next = t->next.load(std::memory_order_acquire);
+
+	if(t == &stub)
+	{
+		if(!next)
+			return nullptr;
+
+		tail = next;
+		t = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if(next)
+	{
+		tail = next;
+		return t;
+	}
+
+	if(t != head.load(std::memory_order_acquire))
+		return nullptr; //A producer is between its exchange and store
+
+	//t is the last node, put the stub behind it so t can be handed out
+	push(&stub);
+
+	next = t->next.load(std::memory_order_acquire);
+	if(next)
+	{
+		tail = next;
+		return t;
+	}
+
+	return nullptr;
+}
+
+MutationQueue::Command* MutationQueue::newest() const
+{
+	Command *h = head.load(std::memory_order_acquire);
+	return h == &stub ? nullptr : h; //The stub is only pushed behind the last node, so nothing precedes it
+}
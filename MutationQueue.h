@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "GLM/glm.hpp"
+
+/*!
+ * \class MutationQueue MutationQueue.h
+ * \brief Lock-free multiple producer, single consumer queue of string mutations.
+ *
+ * An intrusive queue after Dmitry Vyukov's MPSC node-based design: a push is a
+ * single atomic exchange followed by a store, so producers never wait on each
+ * other or on the consumer. Only one thread, the one calling TextEngine::render(),
+ * may pop. Commands are allocated by the producer and deleted by the consumer.
+ */
+class MutationQueue
+{
+public:
+	///Kind of mutation carried by a command
+	enum class Op
+	{
+		Add, ///< Insert a string with a pre-allocated id, uses every field
+		String, ///< Replace the string, uses Command::str
+		Origin, ///< Move the string, uses Command::origin
+		Color, ///< Recolor the string, uses Command::color
+		Remove ///< Remove the string
+	};
+
+	/*!
+	 * \struct MutationQueue::Command MutationQueue.h
+	 * \brief A queued mutation, also the node of the queue.
+	 */
+	struct Command
+	{
+		std::atomic<Command*> next;
+		Op op;
+		unsigned __int64 id;
+		std::string str;
+		glm::ivec2 origin;
+		glm::vec3 color;
+	};
+
+	MutationQueue();
+	~MutationQueue();
+
+	MutationQueue(const MutationQueue&) = delete;
+	MutationQueue& operator=(const MutationQueue&) = delete;
+
+	///Append a command, may be called from any thread
+	/*!
+	 * \param[in] c A command allocated with new, owned by the queue until popped
+	 */
+	void push(Command *c);
+
+	///Remove the oldest command, consumer thread only
+	/*!
+	 * Commands pushed by one thread are popped in the order they were pushed.
+	 * \return The command, to be deleted by the caller, or nullptr if the queue is empty
+	 * or the oldest push has not finished linking its node yet
+	 */
+	Command* pop();
+
+	///Most recently pushed command, consumer thread only
+	/*!
+	 * Popping until this command is returned consumes the commands pushed before
+	 * the call and none pushed after it.
+	 * \return The newest command, or nullptr if the queue is empty
+	 */
+	Command* newest() const;
+
+private:
+	std::atomic<Command*> head; ///< Most recently pushed node, written by producers
+	Command *tail; ///< Oldest node, consumer only
+	Command stub; ///< Placeholder node so the queue is never structurally empty
+};
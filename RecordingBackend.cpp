@@ -0,0 +1,108 @@
+#include "RecordingBackend.h"
+
+RecordingBackend::RecordingBackend(unsigned initCapacity) :
+	storage(VERTEX_BYTES * initCapacity), cap{ initCapacity }, counters{}, nextStatic{ 1 }
+{
+}
+
+bool RecordingBackend::reserve(unsigned glyphs)
+{
+	if(glyphs <= cap)
+		return false;
+
+	cap = grow(cap, glyphs); //Same growth as the VBO, so reallocation counts match
+
+	storage.resize(VERTEX_BYTES * cap);
+	counters.reallocations++;
+	return true;
+}
+
+unsigned RecordingBackend::capacity() const
+{
+	return cap;
+}
+
+unsigned char* RecordingBackend::mapVertices(std::size_t offset, std::size_t bytes)
+{
+	counters.maps++;
+	counters.bytesMapped += bytes;
+	return storage.data() + offset;
+}
+
+void RecordingBackend::unmapVertices()
+{
+}
+
+void RecordingBackend::beginFrame()
+{
+	counters.frames++;
+	drawn.clear();
+}
+
+void RecordingBackend::draw(unsigned glyphs)
+{
+	counters.draws++;
+	counters.glyphsDrawn += glyphs;
+	drawn.emplace_back(0, static_cast<int>(glyphs));
+}
+
+void RecordingBackend::drawRanges(const int *first, const int *count, unsigned ranges)
+{
+	counters.draws++;
+	counters.ranges += ranges;
+	for(unsigned r = 0; r < ranges; r++)
+	{
+		counters.glyphsDrawn += count[r];
+		drawn.emplace_back(first[r], count[r]);
+	}
+}
+
+unsigned RecordingBackend::createStatic(const unsigned char *vertices, unsigned glyphs)
+{
+	statics[nextStatic].assign(vertices, vertices + VERTEX_BYTES * glyphs);
+	counters.staticBytes += VERTEX_BYTES * glyphs;
+	return nextStatic++;
+}
+
+void RecordingBackend::drawStatic(unsigned handle, unsigned glyphs)
+{
+	counters.draws++;
+	counters.staticDraws++;
+	counters.glyphsDrawn += glyphs;
+}
+
+void RecordingBackend::destroyStatic(unsigned handle)
+{
+	statics.erase(handle);
+}
+
+const RecordingBackend::Calls& RecordingBackend::calls() const
+{
+	return counters;
+}
+
+const std::vector<std::pair<int, int>>& RecordingBackend::frameRanges() const
+{
+	return drawn;
+}
+
+void RecordingBackend::reset()
+{
+	counters = Calls{};
+}
+
+const unsigned char* RecordingBackend::vertices() const
+{
+	return storage.data();
+}
+
+const unsigned char* RecordingBackend::staticVertices(unsigned handle) const
+{
+	auto found = statics.find(handle);
+	return found == statics.end() ? nullptr : found->second.data();
+}
+
+std::size_t RecordingBackend::staticCount() const
+{
+	return statics.size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "RenderBackend.h"
+
+/*!
+ * \class RecordingBackend RecordingBackend.h
+ * \brief A RenderBackend without a graphics API.
+ *
+ * Vertices are written into an in-memory buffer that grows like the OpenGL VBO,
+ * and every call is counted. Used to test and profile TextEngine on machines
+ * without a context; drawing does nothing but count.
+ */
+class RecordingBackend : public RenderBackend
+{
+public:
+	/*!
+	 * \struct RecordingBackend::Calls RecordingBackend.h
+	 * \brief Counters of the calls made by the engine.
+	 */
+	struct Calls
+	{
+		unsigned frames;
+		unsigned maps;
+		unsigned __int64 bytesMapped;
+		unsigned draws; ///< draw() and drawRanges() calls
+		unsigned ranges; ///< Ranges passed to drawRanges()
+		unsigned __int64 glyphsDrawn;
+		unsigned reallocations;
+		unsigned staticDraws; ///< drawStatic() calls, also counted in draws
+		unsigned __int64 staticBytes; ///< Bytes copied by createStatic()
+	};
+
+	///Create a backend with room for initCapacity vertices
+	explicit RecordingBackend(unsigned initCapacity);
+
+	bool reserve(unsigned glyphs) override;
+	unsigned capacity() const override;
+	unsigned char* mapVertices(std::size_t offset, std::size_t bytes) override;
+	void unmapVertices() override;
+	void beginFrame() override;
+	void draw(unsigned glyphs) override;
+	void drawRanges(const int *first, const int *count, unsigned ranges) override;
+	unsigned createStatic(const unsigned char *vertices, unsigned glyphs) override;
+	void drawStatic(unsigned handle, unsigned glyphs) override;
+	void destroyStatic(unsigned handle) override;
+
+	///Counters since construction or the last reset()
+	const Calls& calls() const;
+
+	///First vertex and count of every range drawn from the vertex storage since the last beginFrame(), draw() adds one range
+	const std::vector<std::pair<int, int>>& frameRanges() const;
+
+	void reset();
+
+	///The vertex storage, capacity() * VERTEX_BYTES bytes
+	const unsigned char* vertices() const;
+
+	///The vertices of a static storage, nullptr if the handle does not exist
+	const unsigned char* staticVertices(unsigned handle) const;
+
+	///Number of static storages alive
+	std::size_t staticCount() const;
+
+private:
+	std::vector<unsigned char> storage;
+	unsigned cap;
+	Calls counters;
+	std::vector<std::pair<int, int>> drawn;
+	std::map<unsigned, std::vector<unsigned char>> statics;
+	unsigned nextStatic;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+
+/*!
+ * \class RenderBackend RenderBackend.h
+ * \brief Storage and drawing of the glyph vertices formatted by a TextEngine.
+ *
+ * TextEngine keeps the strings, tracks what changed and formats vertices without
+ * touching a graphics API; everything that does is behind this interface.
+ * GLBackend is the OpenGL 4.5 implementation, RecordingBackend keeps the vertices
+ * in memory and counts calls so the engine can run without a context.
+ */
+class RenderBackend
+{
+public:
+	static constexpr std::size_t VERTEX_BYTES = 24; ///< Bytes per vertex of glyph (2 ints xy + 3 floats rgb + 1 uint index)
+	static constexpr std::size_t CODE_BYTES = 4; ///< Bytes per code point for device expansion
+	static constexpr std::size_t RUN_BYTES = 32; ///< Bytes per string record for device expansion (2 ints origin + 2 uints first/count + 3 floats rgb + padding)
+
+	virtual ~RenderBackend() { }
+
+	///Make room for at least glyphs vertices
+	/*!
+	 * Vertices already written must be preserved.
+	 * \return true if the storage had to be reallocated
+	 */
+	virtual bool reserve(unsigned glyphs) = 0;
+
+	///Number of vertices the storage holds without reallocating
+	virtual unsigned capacity() const = 0;
+
+	///Map a byte range of the vertex storage for writing
+	/*!
+	 * The previous contents of the range are discarded.
+	 * \return Pointer to the first byte of the range, valid until unmapVertices()
+	 */
+	virtual unsigned char* mapVertices(std::size_t offset, std::size_t bytes) = 0;
+
+	virtual void unmapVertices() = 0;
+
+	///Whether vertices are expanded from code points by the backend instead of being formatted by the engine
+	virtual bool expandsCodePoints() const { return false; }
+
+	///Map storage for the code points of a range of glyphs and one record per string
+	/*!
+	 * Only called when expandsCodePoints() is true.
+	 * \param[in] firstGlyph Vertex index of the first code point
+	 * \param[in] glyphs Number of code points
+	 * \param[in] strings Number of string records
+	 * \param[out] codes Destination of glyphs * CODE_BYTES bytes
+	 * \param[out] runs Destination of strings * RUN_BYTES bytes
+	 */
+	virtual void mapCodePoints(unsigned firstGlyph, unsigned glyphs, unsigned strings, unsigned char **codes, unsigned char **runs) { }
+
+	///Unmap the code points and expand them into the vertex storage
+	virtual void expandCodePoints(unsigned strings) { }
+
+	///Called at the start of every frame, before any update
+	virtual void beginFrame() { }
+
+	///Draw the first glyphs vertices
+	virtual void draw(unsigned glyphs) = 0;
+
+	///Draw several ranges of vertices
+	/*!
+	 * \param[in] first First vertex of every range
+	 * \param[in] count Number of vertices of every range
+	 * \param[in] ranges Number of ranges
+	 */
+	virtual void drawRanges(const int *first, const int *count, unsigned ranges) = 0;
+
+	///Create immutable storage for vertices that are drawn but never rewritten
+	/*!
+	 * \param[in] vertices glyphs * VERTEX_BYTES bytes, copied before returning
+	 * \param[in] glyphs Number of vertices, at least 1
+	 * \return A nonzero handle for drawStatic() and destroyStatic()
+	 */
+	virtual unsigned createStatic(const unsigned char *vertices, unsigned glyphs) = 0;
+
+	///Draw every vertex of a static storage
+	virtual void drawStatic(unsigned handle, unsigned glyphs) = 0;
+
+	virtual void destroyStatic(unsigned handle) = 0;
+
+	///Called at the end of every frame
+	/*!
+	 * \return An error code, 0 if the frame completed without error
+	 */
+	virtual unsigned endFrame() { return 0; }
+
+	///Device time of a recent frame
+	/*!
+	 * \param[out] ms Set to the time in milliseconds when a measurement is available
+	 * \return true if ms was set
+	 */
+	virtual bool gpuMilliseconds(double &ms) { return false; }
+
+protected:
+	///Capacity after growing by 1.5x until glyphs vertices fit
+	static unsigned grow(unsigned capacity, unsigned glyphs)
+	{
+		if(capacity < 2) capacity = 2; //1.5x of 0 or 1 would never grow
+		while(capacity < glyphs)
+			capacity *= 1.5;
+		return capacity;
+	}
+};
@@ -53,8 +53,17 @@ int main()
 		manager.bakeTextureAtlas();
 		//Output texture atlas as image file to inspect later
 		//store_image("fontatlas.png", const_cast<BYTE*>(manager.raw()), FIF_PNG, manager.mapWidth(), manager.mapHeight(), manager.mapWidth(), 8);
+#ifdef _DEBUG
+		AtlasCompression::Accuracy rgtc = AtlasCompression::rgtc1Accuracy(manager.raw(), manager.mapWidth(), manager.mapHeight());
+		std::cout << "RGTC1 atlas error, max: " << rgtc.maxError << " mean: " << rgtc.meanError
+			<< " PSNR: " << rgtc.psnr << " dB, texels changed: " << rgtc.changed << std::endl;
+		manager.compressBitmap();
+		std::cout << "Atlas CPU copy: " << manager.mapWidth() * manager.mapHeight() << " bytes, LZ: " << manager.bitmapBytes() << " bytes" << std::endl;
+#endif
 		
-		TextEngine engine{manager, prg, 800, 600, 5};
+		GLBackend backend{manager, prg, 800, 600, 5};
+		TextEngine engine{manager, backend};
+		manager.compressBitmap(); //Uploaded, a small copy is kept so a later backend can upload it again
 		unsigned __int64 a_id = engine.addString(a, glm::ivec2{50, 50}, glm::vec3{1.0, 0.2, 0.2});
 		unsigned __int64 b_id = engine.addString(b, glm::ivec2{50, 100}, glm::vec3{0.0, 1.0, 0.5});
 		unsigned __int64 c_id = engine.addString(c, glm::ivec2{50, 150}, glm::vec3{0.5, 0.0, 0.5});
@@ -66,8 +75,8 @@ int main()
 		unsigned __int64 f_id = engine.addString(f, glm::ivec2{ 50, 400 }, glm::vec3{ 1.0, 0.0, 0.0 });
 
 		/*engine.render();
-		engine.printVBO();
-		engine.printSSBO();*/
+		backend.printVBO(engine.glyphCount());
+		FontResource::acquire(manager)->printSSBO();*/
 
 		engine.addString(g, glm::ivec2{ 200, 350 }, glm::vec3{ 0.8, 0.8, 0.8 });
 
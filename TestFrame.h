@@ -3,6 +3,8 @@
 
 #include "FontManager.h"
 #include "TextEngine.h"
+#include "GLBackend.h"
+#include "AtlasCompression.h"
 
 #include "FreeImage.h"
 #include "glm/gtc/matrix_transform.hpp"
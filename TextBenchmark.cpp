@@ -0,0 +1,432 @@
+#include "TextBenchmark.h"
+
+/*
+	Headless benchmarks for atlas baking, layout and buffer updates.
+
+	Usage: TextBenchmark [benchmark flags] [font.ttf]
+	Results can be saved for comparison between versions with
+		--benchmark_out=results.json --benchmark_out_format=json
+	Engine benchmarks run against a RecordingBackend, which needs no context,
+	and against GLBackend, which needs OpenGL 4.5; without a GPU, run with
+	LIBGL_ALWAYS_SOFTWARE=1 to get Mesa's llvmpipe. The OpenGL variants are
+	skipped if no context can be created.
+*/
+
+namespace
+{
+	FT_Library ft;
+	const char *fontPath = "Mecha.ttf";
+	FontManager *engineFont = nullptr; ///< ASCII atlas shared by the engine benchmarks, baked once
+	glwrap::Program *textProgram = nullptr; ///< Only set when a context exists
+	glwrap::Program *layoutProgram = nullptr;
+	glm::ivec4 offscreen{ -1, -1, 0, 0 }; ///< Has no area, so every string is culled, GPU laid out ones included, and frames measure the update and not the rasterizer
+
+	///Printable ASCII line, different for every i
+	std::string make_line(unsigned i, unsigned length)
+	{
+		std::string line(length, ' ');
+		for(unsigned c = 0; c < length; c++)
+			line[c] = static_cast<char>(33 + (i * 7 + c * 13) % 94);
+		return line;
+	}
+
+	///Add count lines of the given length to the engine, stacked like a log view
+	std::vector<unsigned __int64> fill_engine(TextEngine &engine, unsigned count, unsigned length)
+	{
+		std::vector<unsigned __int64> ids;
+		ids.reserve(count);
+		
+		glm::vec3 color{ 0.8f, 0.8f, 0.8f };
+		for(unsigned i = 0; i < count; i++)
+		{
+			glm::ivec2 origin{ 4, static_cast<int>(i * 16) };
+			ids.push_back(engine.addString(make_line(i, length), origin, color));
+		}
+		
+		return ids;
+	}
+	
+	///Backend for an engine benchmark, selected by the last argument: 0 records in memory, 1 is OpenGL, 2 is OpenGL with compute layout
+	std::unique_ptr<RenderBackend> make_backend(benchmark::State &state, unsigned capacity)
+	{
+		const long kind = state.range(2);
+		
+		if(kind == 0)
+			return std::unique_ptr<RenderBackend>{ new RecordingBackend{ capacity } };
+		
+		if(!textProgram)
+		{
+			state.SkipWithError("No OpenGL 4.5 context");
+			return nullptr;
+		}
+		
+		GLBackend *gl = new GLBackend{ *engineFont, *textProgram, 800, 600, capacity };
+		if(kind == 2) gl->useGpuLayout(layoutProgram);
+		return std::unique_ptr<RenderBackend>{ gl };
+	}
+	
+	///Wait for the device so its work is part of the measured frame
+	void finish(benchmark::State &state)
+	{
+		if(state.range(2) != 0) glFinish();
+	}
+	
+	///Upload volume and reallocations during the timed loop, before is taken after setup
+	void report_engine(benchmark::State &state, const TextEngine &engine, const TextEngine::Stats &before)
+	{
+		state.counters["bytes_per_frame"] = benchmark::Counter(static_cast<double>(engine.stats().totalBytesUploaded - before.totalBytesUploaded),
+			benchmark::Counter::kAvgIterations);
+		state.counters["reallocations"] = engine.stats().reallocations - before.reallocations;
+	}
+}
+
+///Bake an atlas from scratch: args are one past the last code point, pixel height and subpixel phases
+static void BM_BakeTextureAtlas(benchmark::State &state)
+{
+	const unsigned charpast = static_cast<unsigned>(state.range(0));
+	const unsigned size = static_cast<unsigned>(state.range(1));
+	const unsigned phases = static_cast<unsigned>(state.range(2));
+	int atlasWidth = 0;
+	
+	for(auto _ : state)
+	{
+		FontManager manager{ ft, fontPath, 0, size, 32, charpast, phases };
+		manager.bakeTextureAtlas();
+		benchmark::DoNotOptimize(manager.raw());
+		atlasWidth = manager.mapWidth();
+	}
+	
+	state.SetItemsProcessed(state.iterations() * (charpast - 32) * phases);
+	state.counters["atlas_width"] = atlasWidth;
+}
+
+static void bake_arguments(benchmark::internal::Benchmark *b)
+{
+	for(int charpast : { 127, 256, 1024 })
+		for(int size : { 12, 24, 48 })
+			b->Args({ charpast, size, 1 });
+	
+	b->Args({ 127, 24, 4 }); //Subpixel phases
+}
+
+BENCHMARK(BM_BakeTextureAtlas)->Apply(bake_arguments)->Unit(benchmark::kMillisecond);
+
+///Bake one font at five sizes, as a multi-size UI does at startup: arg is whether the sizes share a FontRegistry
+static void BM_BakeSizes(benchmark::State &state)
+{
+	const unsigned sizes[] = { 12, 16, 24, 32, 48 };
+	const bool shared = state.range(0) != 0;
+	
+	for(auto _ : state)
+	{
+		FontRegistry registry{ ft };
+		
+		for(unsigned size : sizes)
+		{
+			if(shared)
+			{
+				FontManager manager{ registry, fontPath, 0, size, 32, 127 };
+				manager.bakeTextureAtlas();
+				benchmark::DoNotOptimize(manager.raw());
+			}
+			else
+			{
+				FontManager manager{ ft, fontPath, 0, size, 32, 127 };
+				manager.bakeTextureAtlas();
+				benchmark::DoNotOptimize(manager.raw());
+			}
+		}
+	}
+}
+
+BENCHMARK(BM_BakeSizes)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+///Reformat every string each frame: args are string count, glyphs per string and backend
+static void BM_Layout(benchmark::State &state)
+{
+	const unsigned strings = static_cast<unsigned>(state.range(0));
+	const unsigned length = static_cast<unsigned>(state.range(1));
+	
+	std::unique_ptr<RenderBackend> backend = make_backend(state, strings * length);
+	if(!backend)
+		return;
+	
+	TextEngine engine{ *engineFont, *backend };
+	std::vector<unsigned __int64> ids = fill_engine(engine, strings, length);
+	engine.render(offscreen);
+	finish(state);
+	
+	const TextEngine::Stats before = engine.stats();
+	glm::vec3 colors[2]{ { 1.0f, 1.0f, 1.0f }, { 0.5f, 0.5f, 0.5f } };
+	unsigned frame = 0;
+	
+	for(auto _ : state)
+	{
+		engine.updateColor(ids.front(), colors[frame++ & 1]); //Dirties the whole list
+		engine.render(offscreen);
+		finish(state);
+	}
+	
+	state.SetItemsProcessed(state.iterations() * strings * length);
+	report_engine(state, engine, before);
+}
+
+static void layout_arguments(benchmark::internal::Benchmark *b)
+{
+	for(int backend : { 0, 1, 2 })
+	{
+		b->Args({ 1000, 16, backend });
+		b->Args({ 10000, 16, backend });
+		b->Args({ 10000, 100, backend });
+	}
+}
+
+BENCHMARK(BM_Layout)->Apply(layout_arguments)->Unit(benchmark::kMillisecond);
+
+///Full rebuild of the vertex storage in memory: args are string count, glyphs per string and formatting threads
+static void BM_Rebuild(benchmark::State &state)
+{
+	const unsigned strings = static_cast<unsigned>(state.range(0));
+	const unsigned length = static_cast<unsigned>(state.range(1));
+	
+	RecordingBackend backend{ strings * length };
+	TextEngine engine{ *engineFont, backend };
+	engine.setFormatThreads(static_cast<unsigned>(state.range(2)));
+	fill_engine(engine, strings, length);
+	engine.render();
+	
+	for(auto _ : state)
+	{
+		engine.invalidate();
+		engine.render();
+	}
+	
+	state.SetItemsProcessed(state.iterations() * strings * length);
+	state.counters["format_tasks"] = engine.stats().formatTasks;
+}
+
+static void rebuild_arguments(benchmark::internal::Benchmark *b)
+{
+	for(int threads : { 1, 2, 4, 8 })
+		b->Args({ 10000, 100, threads }); //1M glyphs
+}
+
+BENCHMARK(BM_Rebuild)->Apply(rebuild_arguments)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+///Load a screen of labels into an empty engine and draw it: args are label count and whether a batch is used
+static void BM_LoadScreen(benchmark::State &state)
+{
+	const unsigned labels = static_cast<unsigned>(state.range(0));
+	const bool batch = state.range(1) != 0;
+	glm::vec3 color{ 1.0f, 1.0f, 1.0f };
+	unsigned reallocations = 0;
+	
+	for(auto _ : state)
+	{
+		RecordingBackend backend{ 64 };
+		TextEngine engine{ *engineFont, backend };
+		
+		if(batch) engine.beginBatch();
+		for(unsigned i = 0; i < labels; i++)
+		{
+			glm::ivec2 origin{ 4, static_cast<int>(i * 16) };
+			engine.addString(make_line(i, 12), origin, color);
+		}
+		if(batch) engine.commitBatch();
+		
+		engine.render();
+		reallocations = engine.stats().reallocations;
+	}
+	
+	state.SetItemsProcessed(state.iterations() * labels);
+	state.counters["reallocations"] = reallocations;
+}
+
+BENCHMARK(BM_LoadScreen)->Args({ 5000, 0 })->Args({ 5000, 1 })->Unit(benchmark::kMillisecond);
+
+///Random add, update and remove operations followed by a frame: args are live strings, mutations per frame and backend
+static void BM_Churn(benchmark::State &state)
+{
+	const unsigned strings = static_cast<unsigned>(state.range(0));
+	const unsigned mutations = static_cast<unsigned>(state.range(1));
+	
+	std::unique_ptr<RenderBackend> backend = make_backend(state, 64);
+	if(!backend)
+		return;
+	
+	TextEngine engine{ *engineFont, *backend };
+	std::vector<unsigned __int64> ids = fill_engine(engine, strings, 24);
+	engine.render(offscreen);
+	finish(state);
+	
+	const TextEngine::Stats before = engine.stats();
+	std::minstd_rand rng{ 1234 };
+	glm::vec3 color{ 0.2f, 0.9f, 0.2f };
+	unsigned serial = strings;
+	
+	for(auto _ : state)
+	{
+		for(unsigned m = 0; m < mutations; m++)
+		{
+			std::size_t slot = rng() % ids.size();
+			
+			switch(rng() % 4)
+			{
+			case 0: //Replace a string with a new one at the end of the list
+			{
+				engine.removeString(ids[slot]);
+				glm::ivec2 origin{ 4, static_cast<int>(slot * 16) };
+				ids[slot] = engine.addString(make_line(serial++, 8 + rng() % 32), origin, color);
+				break;
+			}
+			case 1:
+				engine.updateString(ids[slot], make_line(serial++, 8 + rng() % 32));
+				break;
+			case 2:
+				engine.updateOrigin(ids[slot], glm::ivec2{ 8, static_cast<int>(slot * 16) });
+				break;
+			default:
+				engine.updateColor(ids[slot], color);
+				break;
+			}
+		}
+		
+		engine.render(offscreen);
+		finish(state);
+	}
+	
+	state.SetItemsProcessed(state.iterations() * mutations);
+	report_engine(state, engine, before);
+}
+
+static void churn_arguments(benchmark::internal::Benchmark *b)
+{
+	for(int backend : { 0, 1 })
+		for(int strings : { 1000, 10000 })
+			for(int mutations : { 1, 100 })
+				b->Args({ strings, mutations, backend });
+}
+
+BENCHMARK(BM_Churn)->Apply(churn_arguments)->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char **argv)
+{
+	benchmark::Initialize(&argc, argv);
+	if(argc > 1) fontPath = argv[1];
+	
+	if(FT_Init_FreeType(&ft))
+		return 1;
+	
+	HeadlessContext ctx{ EGL_NO_DISPLAY, EGL_NO_CONTEXT };
+	std::unique_ptr<glwrap::Program> textPrg, layoutPrg; //Program objects need a context to be created and deleted
+	
+	if(create_headless_context(ctx))
+	{
+		glewExperimental = GL_TRUE;
+		glewInit();
+		
+		textPrg.reset(new glwrap::Program{});
+		layoutPrg.reset(new glwrap::Program{});
+		build_text_program(*textPrg);
+		build_layout_program(*layoutPrg);
+		textProgram = textPrg.get();
+		layoutProgram = layoutPrg.get();
+	}
+	else
+	{
+		std::cerr << "No headless OpenGL 4.5 context, OpenGL benchmarks are skipped" << std::endl;
+	}
+	
+	engineFont = new FontManager{ ft, fontPath, 0, 16, 32, 127 };
+	engineFont->bakeTextureAtlas();
+	
+	benchmark::RunSpecifiedBenchmarks();
+	
+	delete engineFont; //Before the library is uninitialized, like in TestFrame
+	textProgram = layoutProgram = nullptr;
+	textPrg.reset();
+	layoutPrg.reset(); //While the context is still current
+	destroy_headless_context(ctx);
+	FT_Done_FreeType(ft);
+	return 0;
+}
+
+bool create_headless_context(HeadlessContext &ctx)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	
+	ctx.display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+	if(ctx.display == EGL_NO_DISPLAY)
+		ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	
+	if(ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, nullptr, nullptr))
+		return false;
+	
+	if(!eglBindAPI(EGL_OPENGL_API))
+		return false;
+	
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, //The default, EGL_WINDOW_BIT, matches nothing on a surfaceless display
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if(!eglChooseConfig(ctx.display, configAttribs, &config, 1, &configs) || configs == 0)
+		return false;
+	
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, contextAttribs);
+	if(ctx.context == EGL_NO_CONTEXT)
+		return false;
+	
+	//Surfaceless, nothing is ever presented
+	return eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context) == EGL_TRUE;
+}
+
+void destroy_headless_context(HeadlessContext &ctx)
+{
+	if(ctx.display == EGL_NO_DISPLAY)
+		return;
+	
+	eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(ctx.context != EGL_NO_CONTEXT)
+		eglDestroyContext(ctx.display, ctx.context);
+	eglTerminate(ctx.display);
+}
+
+void build_text_program(glwrap::Program &prg)
+{
+	glwrap::Sourcer vsc{ L"text_vs.glsl" }, gsc{ L"text_gs.glsl" }, fsc{ L"text_fs.glsl" };
+	glwrap::Shader vs{ GL_VERTEX_SHADER }, gs{ GL_GEOMETRY_SHADER }, fs{ GL_FRAGMENT_SHADER };
+	vs.compile(vsc.string());
+	gs.compile(gsc.string());
+	fs.compile(fsc.string());
+	
+	prg.attach(vs);
+	prg.attach(gs);
+	prg.attach(fs);
+	prg.link();
+	vs.clear();
+	gs.clear();
+	fs.clear();
+	prg.log();
+}
+
+void build_layout_program(glwrap::Program &prg)
+{
+	glwrap::Sourcer csc{ L"text_cs.glsl" };
+	glwrap::Shader cs{ GL_COMPUTE_SHADER };
+	cs.compile(csc.string());
+	
+	prg.attach(cs);
+	prg.link();
+	cs.clear();
+	prg.log();
+}
\ No newline at end of file
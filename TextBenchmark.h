@@ -0,0 +1,40 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FontManager.h"
+#include "TextEngine.h"
+#include "GLBackend.h"
+#include "RecordingBackend.h"
+
+#include "benchmark/benchmark.h"
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+
+#include "Sourcer.h"
+#include "Shader.h"
+#include "Program.h"
+
+/*!
+ * \struct HeadlessContext TextBenchmark.h
+ * \brief An OpenGL 4.5 core context without a window or display server.
+ */
+struct HeadlessContext
+{
+	EGLDisplay display;
+	EGLContext context;
+};
+
+///Create and make current a surfaceless context, Mesa's llvmpipe works when no GPU is present
+bool create_headless_context(HeadlessContext &ctx);
+
+void destroy_headless_context(HeadlessContext &ctx);
+
+///Compile and link text_vs.glsl, text_gs.glsl and text_fs.glsl, the log is printed
+void build_text_program(glwrap::Program &prg);
+
+///Compile and link text_cs.glsl, the log is printed
+void build_layout_program(glwrap::Program &prg);
\ No newline at end of file
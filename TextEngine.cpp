@@ -1,102 +1,153 @@
 #include "TextEngine.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
 
-#ifdef _DEBUG
-#include <iostream>
-#endif
-
-TextEngine::TextEngine(const FontManager &mgr, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity) :
-	scX{ width }, scY{ height },
-	manager{ mgr }, program{ prg },
-	texture{ GL_TEXTURE_2D, 1, GL_R8UI, mgr.mapWidth(), mgr.mapHeight(), 0 },
-	range{ mgr.charpast() - mgr.charbase() }, glyphs{ 0 }, capacity{ initCapacity },
+TextEngine::TextEngine(const FontManager &mgr, RenderBackend &be) :
+	manager{ mgr }, backend{ be },
+	glyphs{ 0 },
 	update{ false }, text_id{ 0 }, updateIndex{ 0 }, updateOffset{ 0 },
+	counters{}, pendingMutations{ 0 }, trace{ nullptr },
 	updateIterator{ displayList.end() },
-	orthographic{ glm::ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height)) }
+	pool{ nullptr }, formatThreads{ 0 }, parallelGlyphs{ PARALLEL_GLYPHS }, batching{ false }
+{
+}
+
+TextEngine::~TextEngine()
 {
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	for(auto &entry : staticBlocks)
+		if(entry.second.handle)
+			backend.destroyStatic(entry.second.handle);
 	
-	glCreateBuffers(1, &vbo);
-	glNamedBufferStorage(vbo, VERTEX_BYTES * capacity, NULL, GL_MAP_WRITE_BIT);
-	glVertexArrayVertexBuffer(vao, 0, vbo, 0, VERTEX_BYTES);
+	delete pool;
+}
+
+void TextEngine::render()
+{
+	beginFrame();
 	
-	glVertexArrayAttribIFormat(vao, 0, 2, GL_INT, 0);
-	glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, 8);
-	glVertexArrayAttribIFormat(vao, 2, 1, GL_UNSIGNED_INT, 20);
+	drawStaticBlocks(nullptr);
 	
-	glVertexArrayAttribBinding(vao, 0, 0); //Origin
-	glVertexArrayAttribBinding(vao, 1, 0); //Color
-	glVertexArrayAttribBinding(vao, 2, 0); //Map Index
+	if(glyphs != 0)
+	{
+		backend.draw(glyphs);
+		counters.glyphsDrawn += glyphs;
+	}
 
-	glEnableVertexArrayAttrib(vao, 0);
-	glEnableVertexArrayAttrib(vao, 1);
-	glEnableVertexArrayAttrib(vao, 2);
+	endFrame();
+}
+
+void TextEngine::render(const glm::ivec4 &viewport)
+{
+	beginFrame();
 	
-	glCreateBuffers(1, &ssbo);
-	glNamedBufferStorage(ssbo, META_BYTES * range, NULL, GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
-	loadMetaInfo();
+	drawStaticBlocks(&viewport);
+	cull(viewport);
+	
+	if(!drawFirst.empty())
+	{
+		backend.drawRanges(drawFirst.data(), drawCount.data(), static_cast<unsigned>(drawFirst.size()));
+		for(int count : drawCount)
+			counters.glyphsDrawn += count;
+	}
 
-	texture.store(0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, manager.raw());
-	//Change to glwrap::Sampler
-	/*glTextureParameteri(texture.id(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTextureParameteri(texture.id(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTextureParameteri(texture.id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(texture.id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);*/
+	endFrame();
 }
 
-TextEngine::~TextEngine()
+const TextEngine::Stats& TextEngine::stats() const
 {
-	glDeleteBuffers(1, &ssbo);
-	glDeleteBuffers(1, &vbo);
-	glDeleteVertexArrays(1, &vao);
+	return counters;
 }
 
-void TextEngine::render()
+void TextEngine::setTrace(TextTrace *t)
 {
-	if(update) updateBuffer();
-	
-	if(glyphs != 0)
+	trace = t;
+}
+
+void TextEngine::invalidate()
+{
+	if(!displayList.empty())
 	{
-		program.use();
-		program.setMat4(0, glm::value_ptr(orthographic));
-		texture.bind(0);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
-		glBindVertexArray(vao);
-		glDrawArrays(GL_POINTS, 0, glyphs);
+		update = true;
+		markUpdate(displayList.begin(), 0);
 	}
+}
 
-	GLenum err = glGetError();
-	if (err) exit(err);
+unsigned TextEngine::glyphCount() const
+{
+	return glyphs;
 }
 
-unsigned __int64 TextEngine::addString(const std::string &s, glm::ivec2 &origin, glm::vec3 &color)
+unsigned __int64 TextEngine::addStaticBlock(const StaticString *strings, std::size_t count)
 {
-	update = true;
+	unsigned __int64 id = reserveId();
+	StaticBlock block{ 0, 0, glm::ivec4{ INT_MAX, INT_MAX, INT_MIN, INT_MIN } };
 	
-	/*
-		Since the id is pushed to the back of the list first,
-		the list will always have an element,
-		allowing for a valid iterator to one before the end() of the list.
-	*/
-	displayList.push_back(text_id); 
-	//TO DO: Check to make sure the list isn't empty, otherwise --displayList.end() is invalid
-	std::list<unsigned __int64>::iterator pos = --displayList.end();
-	display[text_id] = Info{s, origin, color, pos, glyphs * VERTEX_BYTES};
-	
-	if (changeUpdateInfo(pos, glyphs * VERTEX_BYTES))
-		;
-	else if (displayList.size() == 1)
-		updateIterator = displayList.begin();
+	for(std::size_t i = 0; i < count; i++)
+		block.glyphs += static_cast<unsigned>(strings[i].str.length());
 	
-	glyphs += s.length();
-	text_id++;
+	recordMutation("addStaticBlock", id, block.glyphs);
 	
-	return text_id - 1; //The id of the newly added string is the incremented counter minus one
+	if(block.glyphs != 0)
+	{
+		//Formatted into a temporary buffer, only the backend keeps the vertices
+		std::vector<unsigned char> vertices(VERTEX_BYTES * block.glyphs);
+		unsigned char *ptr = vertices.data();
+		
+		for(std::size_t i = 0; i < count; i++)
+		{
+			Info info{ strings[i].str, strings[i].origin, strings[i].color };
+			loadString(ptr, info);
+			ptr += info.str.length() * VERTEX_BYTES;
+			
+			if(info.str.empty())
+				continue;
+			
+			block.bounds.x = std::min(block.bounds.x, info.bounds.x);
+			block.bounds.y = std::min(block.bounds.y, info.bounds.y);
+			block.bounds.z = std::max(block.bounds.z, info.bounds.z);
+			block.bounds.w = std::max(block.bounds.w, info.bounds.w);
+		}
+		
+		block.handle = backend.createStatic(vertices.data(), block.glyphs);
+		counters.totalBytesUploaded += vertices.size();
+		counters.staticGlyphs += block.glyphs;
+	}
+	
+	staticBlocks[id] = block;
+	return id;
+}
+
+bool TextEngine::removeStaticBlock(unsigned __int64 id)
+{
+	recordMutation("removeStaticBlock", id, 0);
+	
+	auto found = staticBlocks.find(id);
+	if(found == staticBlocks.end())
+		return false;
+	
+	if(found->second.handle)
+		backend.destroyStatic(found->second.handle);
+	
+	counters.staticGlyphs -= found->second.glyphs;
+	staticBlocks.erase(found);
+	
+	return true;
+}
+
+unsigned __int64 TextEngine::addString(const std::string &s, glm::ivec2 &origin, glm::vec3 &color)
+{
+	unsigned __int64 id = reserveId();
+	recordMutation("addString", id, s.length());
+	insertString(id, s, origin, color);
+	
+	return id;
 }
 
 bool TextEngine::removeString(unsigned __int64 id)
 {	
 	update = true;
+	recordMutation("removeString", id, 0);
 	
 	if(display.find(id) == display.end())
 		return false;
@@ -110,9 +161,13 @@ bool TextEngine::removeString(unsigned __int64 id)
 	
 	glyphs -= glyphs_removed;
 	
-	changeUpdateInfo(update_pos, ref.offset);
-
+	if(pos == updateIterator)
+		updateIterator = update_pos; //Was the first string to rewrite, the next one takes its place and offset
+	
+	//Erased first, so the index compared by changeUpdateInfo() is the one the following string will have
 	displayList.erase(pos);
+	markUpdate(update_pos, ref.offset); //The following string moves
+
 	display.erase(display.find(id));
 	
 	return true;
@@ -121,6 +176,7 @@ bool TextEngine::removeString(unsigned __int64 id)
 bool TextEngine::updateString(unsigned __int64 id, const std::string &s)
 {
 	update = true;
+	recordMutation("updateString", id, s.length());
 	
 	if(display.find(id) == display.end())
 		return false;
@@ -132,7 +188,7 @@ bool TextEngine::updateString(unsigned __int64 id, const std::string &s)
 	glyphs -= glyphs_removed;
 	glyphs += s.length();
 	
-	changeUpdateInfo(ref.position, ref.offset);
+	markUpdate(ref.position, ref.offset);
 	
 	return true;
 }
@@ -140,6 +196,7 @@ bool TextEngine::updateString(unsigned __int64 id, const std::string &s)
 bool TextEngine::updateOrigin(unsigned __int64 id, const glm::ivec2 &origin)
 {
 	update = true;
+	recordMutation("updateOrigin", id, 0);
 
 	if (display.find(id) == display.end())
 		return false;
@@ -147,7 +204,7 @@ bool TextEngine::updateOrigin(unsigned __int64 id, const glm::ivec2 &origin)
 	Info &ref = display[id];
 	ref.origin = origin;
 
-	changeUpdateInfo(ref.position, ref.offset);
+	markUpdate(ref.position, ref.offset);
 
 	return true;
 }
@@ -155,6 +212,7 @@ bool TextEngine::updateOrigin(unsigned __int64 id, const glm::ivec2 &origin)
 bool TextEngine::updateColor(unsigned __int64 id, const glm::vec3 &color)
 {
 	update = true;
+	recordMutation("updateColor", id, 0);
 
 	if (display.find(id) == display.end())
 		return false;
@@ -162,57 +220,283 @@ bool TextEngine::updateColor(unsigned __int64 id, const glm::vec3 &color)
 	Info &ref = display[id];
 	ref.color = color;
 
-	changeUpdateInfo(ref.position, ref.offset);
+	markUpdate(ref.position, ref.offset);
 
 	return true;
 }
 
-#ifdef _DEBUG
-void TextEngine::printVBO()
+void TextEngine::setFormatThreads(unsigned threads, unsigned minGlyphs)
 {
-	unsigned char *base = static_cast<unsigned char*>(glMapNamedBufferRange(vbo, 0, VERTEX_BYTES * glyphs, GL_MAP_READ_BIT));
-	unsigned char *ptr = base;
+	delete pool;
+	pool = nullptr;
+	formatThreads = threads;
+	parallelGlyphs = minGlyphs;
+}
+
+unsigned __int64 TextEngine::reserveId()
+{
+	return text_id.fetch_add(1, std::memory_order_relaxed);
+}
 
-	for (int i = 0; i < glyphs; i++)
+unsigned __int64 TextEngine::queueAdd(const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color)
+{
+	unsigned __int64 id = reserveId();
+	queueAdd(id, s, origin, color);
+	
+	return id;
+}
+
+void TextEngine::queueAdd(unsigned __int64 id, const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color)
+{
+	MutationQueue::Command *c = makeCommand(MutationQueue::Op::Add, id);
+	c->str = s;
+	c->origin = origin;
+	c->color = color;
+	queue.push(c);
+}
+
+void TextEngine::queueString(unsigned __int64 id, const std::string &s)
+{
+	MutationQueue::Command *c = makeCommand(MutationQueue::Op::String, id);
+	c->str = s;
+	queue.push(c);
+}
+
+void TextEngine::queueOrigin(unsigned __int64 id, const glm::ivec2 &origin)
+{
+	MutationQueue::Command *c = makeCommand(MutationQueue::Op::Origin, id);
+	c->origin = origin;
+	queue.push(c);
+}
+
+void TextEngine::queueColor(unsigned __int64 id, const glm::vec3 &color)
+{
+	MutationQueue::Command *c = makeCommand(MutationQueue::Op::Color, id);
+	c->color = color;
+	queue.push(c);
+}
+
+void TextEngine::queueRemove(unsigned __int64 id)
+{
+	queue.push(makeCommand(MutationQueue::Op::Remove, id));
+}
+
+MutationQueue::Command* TextEngine::makeCommand(MutationQueue::Op op, unsigned __int64 id)
+{
+	MutationQueue::Command *c = new MutationQueue::Command{};
+	c->op = op;
+	c->id = id;
+	return c;
+}
+
+void TextEngine::insertString(unsigned __int64 id, const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color)
+{
+	update = true;
+	
+	auto next = display.upper_bound(id);
+	std::list<unsigned __int64>::iterator pos = displayList.insert(next == display.end() ? displayList.end() : next->second.position, id);
+	glyphs += s.length();
+	
+	if(batching)
+	{
+		Info &ref = display[id] = Info{s, origin, color, pos, 0};
+		ref.dirty = true; //Offset assigned when it is formatted
+		return;
+	}
+	
+	unsigned __int64 dist = std::distance(displayList.begin(), pos);
+	
+	std::ptrdiff_t offset;
+	if(dist == updateIndex)
+		offset = updateOffset; //Takes the place of the first dirty string, whose stored offset may be stale
+	else if(next == display.end())
+		offset = (glyphs - s.length()) * VERTEX_BYTES;
+	else
+		offset = next->second.offset;
+	
+	display[id] = Info{s, origin, color, pos, offset};
+	
+	//Unlike changeUpdateInfo(), an equal index also moves the update start, since the
+	//string now at updateIndex is the new one and the old first dirty string follows it
+	if(dist <= updateIndex)
 	{
-		unsigned uc = *reinterpret_cast<unsigned*>(ptr + 20) + manager.charbase();
-		std::cout << static_cast<void*>(ptr) << ": '" << static_cast<char>(uc) << '\'' << std::endl;
-		std::cout << "\tOrigin: (" << *reinterpret_cast<int*>(ptr) << ", "
-			<< *reinterpret_cast<int*>(ptr + 4) << ')' << std::endl;
-		std::cout << "\tColor: (" << *reinterpret_cast<float*>(ptr + 8) << ", "
-			<< *reinterpret_cast<float*>(ptr + 12) << ", "
-			<< *reinterpret_cast<float*>(ptr + 16) << ')' << std::endl;
-
-		ptr += VERTEX_BYTES;
+		updateIndex = dist;
+		updateOffset = offset;
+		updateIterator = pos;
 	}
+}
 
-	glUnmapNamedBuffer(vbo);
+void TextEngine::applyQueue()
+{
+	enum { STRING = 1, ORIGIN = 2, COLOR = 4 };
+	
+	struct Pending
+	{
+		bool add, remove;
+		unsigned fields; ///< Fields written since the last frame
+		std::string str;
+		glm::ivec2 origin;
+		glm::vec3 color;
+	};
+	
+	std::map<unsigned __int64, Pending> pending; //Sorted, so strings are inserted and updated front to back
+	unsigned commands = 0;
+	
+	//Only what was queued on entry is drained, producers pushing faster than this loop pops would keep it going forever
+	MutationQueue::Command *last = queue.newest();
+	bool drained = last == nullptr;
+	
+	while(!drained)
+	{
+		MutationQueue::Command *c = queue.pop();
+		if(!c)
+			break; //A producer is still linking its command, the rest waits for the next frame
+		
+		drained = c == last;
+		Pending &p = pending[c->id];
+		
+		switch(c->op)
+		{
+		case MutationQueue::Op::Add:
+			p.add = true;
+			p.fields = STRING | ORIGIN | COLOR;
+			p.str = std::move(c->str);
+			p.origin = c->origin;
+			p.color = c->color;
+			break;
+		case MutationQueue::Op::String:
+			p.fields |= STRING;
+			p.str = std::move(c->str);
+			break;
+		case MutationQueue::Op::Origin:
+			p.fields |= ORIGIN;
+			p.origin = c->origin;
+			break;
+		case MutationQueue::Op::Color:
+			p.fields |= COLOR;
+			p.color = c->color;
+			break;
+		case MutationQueue::Op::Remove:
+			p.remove = true;
+			break;
+		}
+		
+		delete c;
+		commands++;
+	}
+	
+	unsigned applied = 0;
+	const bool batched = !pending.empty() && !batching;
+	
+	if(batched)
+		beginBatch();
+	
+	for(auto &entry : pending)
+	{
+		const unsigned __int64 id = entry.first;
+		Pending &p = entry.second;
+		
+		if(p.remove)
+		{
+			if(!p.add) //Added and removed in the same frame, never inserted
+			{
+				removeString(id);
+				applied++;
+			}
+		}
+		else if(p.add)
+		{
+			recordMutation("addString", id, p.str.length());
+			insertString(id, p.str, p.origin, p.color);
+			applied++;
+		}
+		else
+		{
+			if(p.fields & STRING)
+			{
+				updateString(id, p.str);
+				applied++;
+			}
+			if(p.fields & ORIGIN)
+			{
+				updateOrigin(id, p.origin);
+				applied++;
+			}
+			if(p.fields & COLOR)
+			{
+				updateColor(id, p.color);
+				applied++;
+			}
+		}
+	}
+	
+	if(batched)
+		commitBatch();
+	
+	counters.queuedCommands = commands;
+	counters.coalescedCommands = commands - applied;
 }
 
-void TextEngine::printSSBO()
+void TextEngine::beginBatch()
 {
-	unsigned char *base = static_cast<unsigned char*>(glMapNamedBufferRange(ssbo, 0, META_BYTES * range, GL_MAP_READ_BIT));
-	unsigned char *ptr = base;
+	assert(!batching);
+	batching = true;
+	
+	//The pending update start becomes a flag like the batch's own changes, so the scan in commitBatch() cannot pass it
+	if(update && updateIterator != displayList.end())
+		display[*updateIterator].dirty = true;
+}
 
-	for (unsigned u = 0; u < range; u++)
+void TextEngine::commitBatch()
+{
+	assert(batching);
+	batching = false;
+	
+	if(!update)
+		return;
+	
+	unsigned __int64 index = 0;
+	std::ptrdiff_t offset = 0;
+	
+	updateIterator = displayList.end();
+	
+	//The map is in list order (insertString()), so one ordered walk finds the first string to rewrite
+	for(auto &entry : display)
 	{
-		std::cout << static_cast<void*>(ptr) << ": '" << static_cast<char>(u + manager.charbase()) << '\'' << std::endl;
-		std::cout << "\tAdvance X: " << *reinterpret_cast<int*>(ptr)
-			<< " Advance Y: " << *reinterpret_cast<int*>(ptr + 4) << std::endl;
-		std::cout << "\tBitmap Width: " << *reinterpret_cast<unsigned*>(ptr + 8)
-			<< " Bitmap Height: " << *reinterpret_cast<unsigned*>(ptr + 12) << std::endl;
-		std::cout << "\tLeft Bearing: " << *reinterpret_cast<int*>(ptr + 16)
-			<< " Top Bearing: " << *reinterpret_cast<int*>(ptr + 20) << std::endl;
-
-		std::cout << "\tTexel Base X: " << *reinterpret_cast<int*>(ptr + 24)
-			<< " Texel Base Y: " << *reinterpret_cast<int*>(ptr + 28) << std::endl;
-
-		ptr += META_BYTES;
+		Info &ref = entry.second;
+		
+		if(ref.dirty)
+		{
+			updateIterator = ref.position;
+			break;
+		}
+		
+		offset += ref.str.length() * VERTEX_BYTES;
+		index++;
 	}
+	
+	updateIndex = index;
+	updateOffset = offset;
+	
+	reserveStorage();
+}
 
-	glUnmapNamedBuffer(ssbo);
+void TextEngine::markUpdate(std::list<unsigned __int64>::iterator position, std::ptrdiff_t offset)
+{
+	if(!batching)
+		changeUpdateInfo(position, offset);
+	else if(position != displayList.end())
+		display[*position].dirty = true;
+}
+
+void TextEngine::reserveStorage()
+{
+	if(backend.reserve(glyphs))
+	{
+		counters.reallocations++;
+		if(trace) trace->instant("reallocate", 0, backend.capacity());
+	}
 }
-#endif
 
 bool TextEngine::changeUpdateInfo(std::list<unsigned __int64>::iterator comparePosition, std::ptrdiff_t compareOffset)
 {
@@ -228,42 +512,151 @@ bool TextEngine::changeUpdateInfo(std::list<unsigned __int64>::iterator compareP
 	return false;
 }
 
-void TextEngine::updateBuffer()
+void TextEngine::beginFrame()
 {
-	if(glyphs > capacity)
+	frameStart = TextTrace::Clock::now();
+	
+	applyQueue(); //Before the counters below, so drained commands count as mutations of this frame
+	
+	counters.frames++;
+	counters.mutations = pendingMutations;
+	counters.stringsRewritten = 0;
+	counters.glyphsRewritten = 0;
+	counters.formatTasks = 0;
+	counters.glyphsDrawn = 0;
+	counters.bytesUploaded = 0;
+	counters.updateMilliseconds = 0.0;
+	pendingMutations = 0;
+	
+	backend.beginFrame();
+	
+	if(update)
 	{
-		unsigned old_capacity = capacity;
-
-		while(capacity < glyphs)
-			capacity *= 1.5;
+		TextTrace::Clock::time_point start = TextTrace::Clock::now();
+		updateBuffer();
+		TextTrace::Clock::time_point end = TextTrace::Clock::now();
 		
-		GLuint swap;
-		glCreateBuffers(1, &swap);
-		glNamedBufferStorage(swap, VERTEX_BYTES * capacity, NULL, GL_MAP_WRITE_BIT | GL_MAP_READ_BIT);
-		glCopyNamedBufferSubData(vbo, swap, 0, 0, VERTEX_BYTES * old_capacity);
-		glVertexArrayVertexBuffer(vao, 0, swap, 0, VERTEX_BYTES); //Update binding point with new buffer
-		glDeleteBuffers(1, &vbo);
-		vbo = swap; //Store the new buffer name
-
-		//Add some counter or other mechanism to shrink buffer after a while
+		counters.updateMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+		counters.totalBytesUploaded += counters.bytesUploaded;
+		if(trace) trace->complete("updateBuffer", start, end, counters.glyphsRewritten, counters.bytesUploaded);
+	}
+}
+
+void TextEngine::endFrame()
+{
+	unsigned err = backend.endFrame();
+	if(err)
+	{
+		counters.glErrors++;
+		counters.lastError = err;
+		if(trace) trace->instant("glError", err, 0);
 	}
+	
+	backend.gpuMilliseconds(counters.gpuMilliseconds);
+	
+	TextTrace::Clock::time_point end = TextTrace::Clock::now();
+	counters.renderMilliseconds = std::chrono::duration<double, std::milli>(end - frameStart).count();
+	if(trace) trace->complete("render", frameStart, end, counters.glyphsDrawn, counters.bytesUploaded);
+}
 
-	assert(updateIterator != displayList.end());
+void TextEngine::recordMutation(const char *name, unsigned __int64 id, unsigned __int64 glyphCount)
+{
+	pendingMutations++;
+	if(trace) trace->instant(name, id, glyphCount);
+}
 
-	unsigned char *base = static_cast<unsigned char*>(glMapNamedBufferRange(vbo, 0, VERTEX_BYTES * glyphs, GL_MAP_WRITE_BIT));
-	unsigned char *ptr = base;
+void TextEngine::cull(const glm::ivec4 &viewport)
+{
+	drawFirst.clear();
+	drawCount.clear();
 	
-	ptr += updateOffset;
+	int next = -1; //One past the last vertex of the current range
 	
-	while(updateIterator != displayList.end())
+	//displayList is kept sorted by id (insertString()),
+	//so walking the map visits strings in VBO order without a lookup per string
+	for(auto &entry : display)
 	{
-		loadString(ptr, *updateIterator);
-		display[*updateIterator].offset = (ptr - base);
-		ptr += display[*updateIterator].str.length() * VERTEX_BYTES;
-		updateIterator++;
+		const Info &ref = entry.second;
+		
+		if(ref.str.empty())
+			continue;
+		
+		if(outside(ref.bounds, viewport))
+			continue;
+		
+		int first = static_cast<int>(ref.offset / VERTEX_BYTES);
+		int count = static_cast<int>(ref.str.length());
+		
+		if(first == next)
+			drawCount.back() += count; //Directly follows the previous visible string
+		else
+		{
+			drawFirst.push_back(first);
+			drawCount.push_back(count);
+		}
+		
+		next = first + count;
+	}
+}
+
+void TextEngine::drawStaticBlocks(const glm::ivec4 *viewport)
+{
+	for(auto &entry : staticBlocks)
+	{
+		const StaticBlock &block = entry.second;
+		
+		if(block.handle == 0 || (viewport && outside(block.bounds, *viewport)))
+			continue;
+		
+		backend.drawStatic(block.handle, block.glyphs);
+		counters.glyphsDrawn += block.glyphs;
+	}
+}
+
+bool TextEngine::outside(const glm::ivec4 &bounds, const glm::ivec4 &viewport)
+{
+	return viewport.z <= 0 || viewport.w <= 0 || //Nothing overlaps an empty viewport, not even unbounded strings
+		bounds.x >= viewport.x + viewport.z || bounds.z <= viewport.x ||
+		bounds.y >= viewport.y + viewport.w || bounds.w <= viewport.y;
+}
+
+void TextEngine::updateBuffer()
+{
+	assert(!batching);
+	reserveStorage();
+
+	const unsigned firstGlyph = static_cast<unsigned>(updateOffset / VERTEX_BYTES);
+	const unsigned dirtyGlyphs = glyphs - firstGlyph;
+
+	if(updateIterator == displayList.end())
+	{
+		//Only strings at the end of the list were removed, nothing to rewrite
+	}
+	else if(backend.expandsCodePoints())
+	{
+		const unsigned dirtyStrings = static_cast<unsigned>(std::distance(updateIterator, displayList.end()));
+		unsigned char *codes, *runs;
+		
+		backend.mapCodePoints(firstGlyph, dirtyGlyphs, dirtyStrings, &codes, &runs);
+		counters.stringsRewritten += formatCodePoints(codes, runs);
+		backend.expandCodePoints(dirtyStrings);
+		
+		counters.glyphsRewritten += dirtyGlyphs;
+		counters.bytesUploaded += CODE_BYTES * dirtyGlyphs + RUN_BYTES * dirtyStrings;
+	}
+	else if(dirtyGlyphs == 0)
+	{
+		counters.stringsRewritten += formatVertices(nullptr); //Only empty strings, offsets still move
+	}
+	else
+	{
+		unsigned char *span = backend.mapVertices(updateOffset, VERTEX_BYTES * dirtyGlyphs);
+		counters.stringsRewritten += formatVertices(span);
+		backend.unmapVertices();
+		
+		counters.glyphsRewritten += dirtyGlyphs;
+		counters.bytesUploaded += VERTEX_BYTES * dirtyGlyphs;
 	}
-	
-	glUnmapNamedBuffer(vbo);
 		
 	updateIterator = displayList.end();
 	//If a new string is added, updateIndex must be larger than the new position
@@ -273,17 +666,130 @@ void TextEngine::updateBuffer()
 	update = false;
 }
 
-void TextEngine::loadString(unsigned char *offset, unsigned __int64 id)
+unsigned TextEngine::formatVertices(unsigned char *span)
 {
-	Info &ref = display[id];
+	const unsigned dirtyGlyphs = static_cast<unsigned>(glyphs - updateOffset / VERTEX_BYTES);
+	if(dirtyGlyphs >= parallelGlyphs && formatThreads != 1)
+		return formatParallel(span, dirtyGlyphs);
+	
+	unsigned char *ptr = span;
+	unsigned strings = 0;
+	
+	while(updateIterator != displayList.end())
+	{
+		Info &ref = display[*updateIterator];
+		loadString(ptr, ref);
+		ref.dirty = false;
+		ref.offset = updateOffset + (ptr - span);
+		ptr += ref.str.length() * VERTEX_BYTES;
+		updateIterator++;
+		strings++;
+	}
+	
+	counters.formatTasks = 1;
+	return strings;
+}
+
+unsigned TextEngine::formatParallel(unsigned char *span, unsigned dirtyGlyphs)
+{
+	if(!pool)
+		pool = new WorkerPool{ formatThreads ? formatThreads : std::max(1u, std::thread::hardware_concurrency()) };
+	
+	const unsigned chunkGlyphs = dirtyGlyphs / (pool->size() * CHUNKS_PER_THREAD) + 1;
+	
+	dirtyStrings.clear();
+	chunkFirst.clear();
+	
+	std::ptrdiff_t offset = updateOffset;
+	unsigned inChunk = chunkGlyphs; //Start a chunk at the first string
+	
+	while(updateIterator != displayList.end())
+	{
+		Info &ref = display[*updateIterator];
+		
+		if(inChunk >= chunkGlyphs)
+		{
+			chunkFirst.push_back(dirtyStrings.size());
+			inChunk = 0;
+		}
+		
+		ref.offset = offset;
+		ref.dirty = false;
+		dirtyStrings.push_back(&ref);
+		offset += ref.str.length() * VERTEX_BYTES;
+		inChunk += static_cast<unsigned>(ref.str.length());
+		updateIterator++;
+	}
+	chunkFirst.push_back(dirtyStrings.size());
+	
+	const unsigned chunks = static_cast<unsigned>(chunkFirst.size() - 1);
+	pool->parallelFor(chunks, [this, span](unsigned c)
+	{
+		for(std::size_t i = chunkFirst[c]; i < chunkFirst[c + 1]; i++)
+			loadString(span + (dirtyStrings[i]->offset - updateOffset), *dirtyStrings[i]);
+	});
+	
+	counters.formatTasks = chunks;
+	return static_cast<unsigned>(dirtyStrings.size());
+}
 
-	int advanceX = ref.origin.x;
+unsigned TextEngine::formatCodePoints(unsigned char *codes, unsigned char *runs)
+{
+	unsigned vertex = static_cast<unsigned>(updateOffset / VERTEX_BYTES);
+	unsigned strings = 0;
+	
+	while(updateIterator != displayList.end())
+	{
+		Info &ref = display[*updateIterator];
+		unsigned count = static_cast<unsigned>(ref.str.length());
+		
+		*reinterpret_cast<int*>(runs) = ref.origin.x;
+		*reinterpret_cast<int*>(runs + 4) = ref.origin.y;
+		*reinterpret_cast<unsigned*>(runs + 8) = vertex;
+		*reinterpret_cast<unsigned*>(runs + 12) = count;
+		*reinterpret_cast<float*>(runs + 16) = ref.color.r;
+		*reinterpret_cast<float*>(runs + 20) = ref.color.g;
+		*reinterpret_cast<float*>(runs + 24) = ref.color.b;
+		runs += RUN_BYTES;
+		
+		for(unsigned i = 0; i < count; i++)
+		{
+			*reinterpret_cast<unsigned*>(codes) = static_cast<unsigned>(ref.str[i]);
+			codes += CODE_BYTES;
+		}
+		
+		ref.offset = vertex * VERTEX_BYTES;
+		ref.dirty = false;
+		ref.bounds = glm::ivec4{ INT_MIN, INT_MIN, INT_MAX, INT_MAX }; //Unknown on the CPU, only culled by an empty viewport
+		vertex += count;
+		updateIterator++;
+		strings++;
+	}
+	
+	return strings;
+}
+
+void TextEngine::loadString(unsigned char *offset, Info &ref) const
+{
+	const unsigned phases = manager.subpixelPhases();
+
+	int penX = ref.origin.x * 64; //26.6 pen position, fractional only when phases are baked
+	ref.bounds = glm::ivec4{ ref.origin.x, ref.origin.y, ref.origin.x, ref.origin.y };
 	for(int i = 0; i < ref.str.length(); i++)
 	{
 		/*std::cout << "Copying " << '\'' << ref.str[i] << '\'' << std::endl;
 		glm::vec2 tmp = orthographic * glm::vec4{ advanceX, ref.origin.y, 0, 1 };
 		std::cout << '(' << tmp.x << ", " << tmp.y << ')' << std::endl;*/
-		unsigned index = static_cast<unsigned>(ref.str[i]) - manager.charbase();
+		unsigned code = static_cast<unsigned>(ref.str[i]);
+		int advanceX = penX >> 6;
+		unsigned phase = ((penX & 63) * phases + 32) >> 6; //Nearest phase, may round up to the next pixel
+		if(phase == phases)
+		{
+			advanceX++;
+			phase = 0;
+		}
+		
+		unsigned index = manager.glyphIndex(code, phase);
 		*reinterpret_cast<int*>(offset) = advanceX;
 		*reinterpret_cast<int*>(offset + 4) = ref.origin.y;
 		*reinterpret_cast<float*>(offset + 8) = ref.color.r;
@@ -291,42 +797,15 @@ void TextEngine::loadString(unsigned char *offset, unsigned __int64 id)
 		*reinterpret_cast<float*>(offset + 16) = ref.color.b;
 		*reinterpret_cast<unsigned*>(offset + 20) = index;
 		offset += VERTEX_BYTES;
-		advanceX += manager.characterInfo()[index].ax >> 6;
-	}
-}
-
-void TextEngine::loadMetaInfo()
-{
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
-	glShaderStorageBlockBinding(program.id(), 0, 0);
-	
-	const FontManager::CharInfo *info = manager.characterInfo();
-	const FontManager::AtlasMap *map = manager.atlasMap();
-	
-	float map_width = static_cast<float>(manager.mapWidth());
-	float map_height = static_cast<float>(manager.mapHeight());
-	
-	unsigned char *buffer = static_cast<unsigned char*>(glMapNamedBufferRange(ssbo, 0, META_BYTES * range, GL_MAP_WRITE_BIT));
-	
-	for(unsigned u = 0; u < range; u++)
-	{
-		*reinterpret_cast<int*>(buffer) = info[u].ax;
-		*reinterpret_cast<int*>(buffer + 4) = info[u].ay;
-		*reinterpret_cast<unsigned*>(buffer + 8) = info[u].bw;
-		*reinterpret_cast<unsigned*>(buffer + 12) = info[u].bh;
-		*reinterpret_cast<int*>(buffer + 16) = info[u].lb;
-		*reinterpret_cast<int*>(buffer + 20) = info[u].tb;
-
-		*reinterpret_cast<int*>(buffer + 24) = map[u].lx; //X base
-		*reinterpret_cast<int*>(buffer + 28) = map[u].hy; //Y base, high becomes low when flipped
-		/*
-			*reinterpret_cast<float*>(buffer + 24) = static_cast<float>(map[u].lx) / manager.mapWidth();
-			*reinterpret_cast<float*>(buffer + 28) = static_cast<float>(map[u].hx) / manager.mapWidth();
-			*reinterpret_cast<float*>(buffer + 32) = static_cast<float>(manager.mapHeight() - map[u].hy) / manager.mapHeight();
-			*reinterpret_cast<float*>(buffer + 36) = static_cast<float>(manager.mapHeight() - map[u].lx) / manager.mapHeight();
-		*/
-		buffer += META_BYTES;
+		
+		const FontManager::CharInfo &info = manager.characterInfo()[index];
+		int lowX = advanceX + info.lb;
+		int lowY = ref.origin.y - (static_cast<int>(info.bh) - info.tb);
+		ref.bounds.x = std::min(ref.bounds.x, lowX);
+		ref.bounds.y = std::min(ref.bounds.y, lowY);
+		ref.bounds.z = std::max(ref.bounds.z, lowX + static_cast<int>(info.bw));
+		ref.bounds.w = std::max(ref.bounds.w, lowY + static_cast<int>(info.bh));
+		
+		penX += info.ax;
 	}
-	
-	glUnmapNamedBuffer(ssbo);
 }
\ No newline at end of file
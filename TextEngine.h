@@ -1,32 +1,135 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 
 #include "FontManager.h"
-#include "Program.h"
-#include "Texture.h"
-#include "GL/glew.h"
+#include "MutationQueue.h"
+#include "RenderBackend.h"
+#include "TextTrace.h"
+#include "WorkerPool.h"
 #include "GLM/glm.hpp"
-#include "glm/gtc/matrix_transform.hpp"
-#include "glm/gtc/type_ptr.hpp"
 
+/*!
+ * \class TextEngine TextEngine.h
+ * \brief Stores strings, tracks changes and formats their glyph vertices.
+ *
+ * The engine does not use a graphics API; the vertex storage and the draw
+ * calls are provided by a RenderBackend, GLBackend for OpenGL.
+ *
+ * The direct mutators (addString(), updateString(), ...) and render() must be
+ * called from one thread. Other threads use reserveId() and the queue functions
+ * (queueAdd(), queueString(), ...), which are applied at the start of render().
+ * Commands queued while a render() is draining are left for the next one.
+ */
 class TextEngine
 {
 public:
-	explicit TextEngine(const FontManager &mgr, const glwrap::Program &prg, unsigned width, unsigned height, unsigned initCapacity);
+	///Create an engine drawing through a backend
+	/*!
+	 * \param[in] mgr A baked FontManager, provides the glyph advances and bearings
+	 * \param[in] be The backend, not owned, must outlive the engine
+	 */
+	explicit TextEngine(const FontManager &mgr, RenderBackend &be);
 	~TextEngine();
 	
-	///Setup OpenGL state for rendering, then render.
 	/*!
-	 * Uses TextEngine::program, loads the orthographic view matrix,
-	 * binds the texture atlas TextEngine::texture, binds the shader
-	 * storage block buffer, binds the VAO and then makes the single
-	 * draw call for all vertices.
+	 * \struct TextEngine::Stats TextEngine.h
+	 * \brief Cost of the engine, per frame fields describe the last call to render().
+	 */
+	struct Stats
+	{
+		unsigned __int64 frames; ///< Calls to render()
+		unsigned mutations; ///< Mutator calls since the previous frame
+		unsigned stringsRewritten; ///< Strings formatted in the last frame
+		unsigned glyphsRewritten; ///< Glyphs formatted in the last frame
+		unsigned formatTasks; ///< Chunks the last frame's vertices were formatted in, 1 when formatted serially
+		unsigned glyphsDrawn; ///< Vertices submitted in the last frame, after culling
+		unsigned __int64 bytesUploaded; ///< Bytes written through mapped buffers in the last frame
+		unsigned __int64 totalBytesUploaded; ///< Bytes written through mapped buffers since construction
+		unsigned reallocations; ///< Times the vertex storage was reallocated since construction
+		double updateMilliseconds; ///< CPU time spent in updateBuffer() in the last frame
+		double renderMilliseconds; ///< CPU time spent in the last call to render()
+		double gpuMilliseconds; ///< Device time of the most recent measured frame, 0 if the backend does not measure it
+		unsigned glErrors; ///< Frames that ended with a backend error
+		unsigned lastError; ///< Most recent backend error, 0 (GL_NO_ERROR) if none occurred
+		unsigned staticGlyphs; ///< Glyphs held in static blocks
+		unsigned queuedCommands; ///< Queued commands drained at the start of the last frame
+		unsigned coalescedCommands; ///< Of those, commands superseded by a later write to the same id
+	};
+	
+	///Get the counters and timers of the engine
+	const Stats& stats() const;
+	
+	///Record mutations, buffer updates and frames into a trace
+	/*!
+	 * \param[in] t The trace to record into, not owned, nullptr stops recording
+	 */
+	void setTrace(TextTrace *t);
+	
+	///Update the vertex storage if necessary, then draw every string
+	/*!
+	 * Static blocks are drawn first, one draw call each, then the backend makes a
+	 * single draw call for all vertices of the dynamic strings.
 	 */
 	void render();
 	
+	///Render only the strings that overlap a viewport
+	/*!
+	 * Same as render(), but each string's bounding box is tested against the viewport
+	 * first and only the visible strings are submitted. Strings that are adjacent in
+	 * the vertex storage are merged into one range of a single multi-draw call, so the
+	 * number of vertices drawn depends on what is visible rather than on the total
+	 * number of strings.
+	 * \param[in] viewport Lower left x, y, then width and height, in the same coordinates as string origins
+	 *
+	 * Strings expanded by the backend (RenderBackend::expandsCodePoints()) have no
+	 * bounding box on the CPU and are only culled by a viewport without area, which
+	 * draws nothing. Static blocks are culled as a whole, by the bounding box of all
+	 * their strings.
+	 */
+	void render(const glm::ivec4 &viewport);
+	
+	/*!
+	 * \struct TextEngine::StaticString TextEngine.h
+	 * \brief A string of a static block.
+	 */
+	struct StaticString
+	{
+		std::string str;
+		glm::ivec2 origin;
+		glm::vec3 color;
+	};
+	
+	///Lay out strings once into immutable storage drawn by every render()
+	/*!
+	 * The strings are formatted immediately and handed to RenderBackend::createStatic();
+	 * afterwards the engine keeps only the storage handle, glyph count and bounding box
+	 * of the block, not the strings. Dynamic strings are stored separately, so their
+	 * edits never rewrite static text. Blocks are drawn in the order they were added,
+	 * below the dynamic strings, and are always laid out on the CPU.
+	 * \param[in] strings The strings of the block
+	 * \param[in] count Number of strings
+	 * \return The id of the block, for removeStaticBlock()
+	 */
+	unsigned __int64 addStaticBlock(const StaticString *strings, std::size_t count);
+	
+	///Remove a static block and free its storage
+	/*!
+	 * \param[in] id The block id
+	 * \return true if the id was found, false otherwise.
+	 */
+	bool removeStaticBlock(unsigned __int64 id);
+	
+	///Rewrite every string on the next render()
+	/*!
+	 * Needed after the backend changes how it stores vertices, e.g. GLBackend::useGpuLayout().
+	 */
+	void invalidate();
+	
 	///Add the string to the rendering list
 	/*!
 	 * \param[in] s The string to render
@@ -65,24 +168,90 @@ public:
 	* \return true if the id was found, false otherwise.
 	*/
 	bool updateColor(unsigned __int64 id, const glm::vec3 &color);
-#ifdef _DEBUG
-	void printVBO();
-
-	void printSSBO();
-#endif
+	
+	///Number of glyph vertices of all strings
+	unsigned glyphCount() const;
+	
+	///Start applying mutations as one batch
+	/*!
+	 * Until commitBatch(), the mutators only flag the strings they change instead of
+	 * searching the list for the earliest change each time, so thousands of mutations
+	 * cost a map lookup each rather than a list walk each. Batches do not nest, and
+	 * render() must not be called inside one.
+	 */
+	void beginBatch();
+	
+	///Finish a batch started with beginBatch()
+	/*!
+	 * One ordered pass finds the first flagged string, where the next render() starts
+	 * rewriting, and the backend reserves room for the final glyph count at once, so
+	 * loading many strings reallocates the vertex storage at most once.
+	 */
+	void commitBatch();
+	
+	///Set how many threads format vertices in large updates
+	/*!
+	 * Each string's offset in the vertex storage is a prefix sum of the glyph counts before
+	 * it, so once the offsets are known the dirty strings are split into chunks of similar
+	 * glyph counts and formatted concurrently, straight into the mapped storage.
+	 * By default one thread per hardware thread is used, started on the first large update.
+	 * \param[in] threads Threads including the rendering thread, 0 for one per hardware thread, 1 to always format serially
+	 * \param[in] minGlyphs Updates with fewer dirty glyphs are formatted on the rendering thread only
+	 */
+	void setFormatThreads(unsigned threads, unsigned minGlyphs = PARALLEL_GLYPHS);
+	
+	///Allocate a string id, may be called from any thread
+	/*!
+	 * The id is unique for the lifetime of the engine and may be used with queueAdd().
+	 */
+	unsigned __int64 reserveId();
+	
+	///Queue the addition of a string, may be called from any thread
+	/*!
+	 * The string is added at the start of the next render(). Strings are kept in id
+	 * order, so a queued string takes the place its id would have had with addString().
+	 * \return The id of the string, usable with the queue functions immediately
+	 * and with the direct mutators after the next render()
+	 */
+	unsigned __int64 queueAdd(const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color);
+	
+	///Queue the addition of a string under an id from reserveId(), may be called from any thread
+	void queueAdd(unsigned __int64 id, const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color);
+	
+	///Queue updateString(), may be called from any thread
+	void queueString(unsigned __int64 id, const std::string &s);
+	
+	///Queue updateOrigin(), may be called from any thread
+	void queueOrigin(unsigned __int64 id, const glm::ivec2 &origin);
+	
+	///Queue updateColor(), may be called from any thread
+	void queueColor(unsigned __int64 id, const glm::vec3 &color);
+	
+	///Queue removeString(), may be called from any thread
+	/*!
+	 * Queued writes to the id before the removal are discarded, and so is the
+	 * string itself if it was queued for addition in the same frame.
+	 */
+	void queueRemove(unsigned __int64 id);
 	
 private:
-	static constexpr unsigned __int64 VERTEX_BYTES = 24; ///< Bytes per vertex of glyph (2 floats xy + 3 floats rgb + 1 uint index)
-	static constexpr unsigned __int64 META_BYTES = 32; ///< Meta structure size in shader
-	const unsigned scX, scY; ///< Screen dimensions
+	static constexpr std::size_t VERTEX_BYTES = RenderBackend::VERTEX_BYTES;
+	static constexpr std::size_t CODE_BYTES = RenderBackend::CODE_BYTES;
+	static constexpr std::size_t RUN_BYTES = RenderBackend::RUN_BYTES;
+	static constexpr unsigned PARALLEL_GLYPHS = 1 << 16; ///< Default threshold of parallel formatting, below it thread wake-up costs more than it saves
+	static constexpr unsigned CHUNKS_PER_THREAD = 4; ///< Chunks per formatting thread, so one slow chunk does not hold up the update
 	const FontManager &manager;
-	const glwrap::Program &program;
-	glwrap::Texture texture;
-	GLuint vbo, vao, ssbo; ///< Names for the VBO, VAO, and SSBO used in the engine
-	unsigned range, glyphs, capacity;
+	RenderBackend &backend;
+	unsigned glyphs;
 	bool update;
-	unsigned __int64 text_id, updateIndex, updateOffset;
-	glm::mat4 orthographic;
+	std::atomic<unsigned __int64> text_id; ///< Next id, shared with producer threads
+	unsigned __int64 updateIndex, updateOffset;
+	MutationQueue queue; ///< Mutations pushed by other threads, drained by render()
+	
+	Stats counters;
+	unsigned pendingMutations; ///< Mutations since the last frame, moved into TextEngine::counters by render()
+	TextTrace *trace;
+	TextTrace::Clock::time_point frameStart;
 	
 	struct Info
 	{
@@ -91,6 +260,8 @@ private:
 		glm::vec3 color;
 		std::list<unsigned __int64>::iterator position;
 		std::ptrdiff_t offset;
+		glm::ivec4 bounds; ///< Low X, low Y, high X, high Y of the glyph quads, written by loadString()
+		bool dirty; ///< Changed inside a batch, or the string that follows a removal, cleared when formatted
 		
 		/*
 		Info::Info() { }
@@ -105,14 +276,35 @@ private:
 		*/
 	};
 	
+	/*!
+	 * \struct TextEngine::StaticBlock TextEngine.h
+	 * \brief What is kept of a static block once it is uploaded.
+	 */
+	struct StaticBlock
+	{
+		unsigned handle; ///< RenderBackend static storage, 0 for a block without glyphs
+		unsigned glyphs;
+		glm::ivec4 bounds; ///< Union of the bounding boxes of the block's strings
+	};
+	
 	std::map<unsigned __int64, Info> display;
+	std::map<unsigned __int64, StaticBlock> staticBlocks; ///< Ordered by id, which is creation order
 	std::list<unsigned __int64> displayList;
 	std::list<unsigned __int64>::iterator updateIterator;
+	std::vector<int> drawFirst; ///< First vertex of each visible range, reused between frames
+	std::vector<int> drawCount; ///< Vertex count of each visible range
+	
+	WorkerPool *pool; ///< Formatting threads, created by the first parallel update
+	unsigned formatThreads; ///< Requested pool size, 0 for one per hardware thread
+	unsigned parallelGlyphs; ///< Dirty glyphs from which updates are formatted in parallel
+	std::vector<Info*> dirtyStrings; ///< Strings of a parallel update in list order, reused between frames
+	std::vector<std::size_t> chunkFirst; ///< Index in TextEngine::dirtyStrings of the first string of each chunk, plus the end
+	bool batching; ///< Between beginBatch() and commitBatch()
 
 	///Change update information if necessary
 	/*!
 	 * \param[in] comparePosition iterator to the id in TextEngine::displayList that was updated
-	 * \param[in] compareOffset byte offset of the first glyph of the string in the VBO
+	 * \param[in] compareOffset byte offset of the first glyph of the string in the vertex storage
 	 *
 	 * Updates TextEngine::updateIndex, TextEngine::updateOffset, and TextEngine::updateIterator
 	 * with the value of the paramaters if and only if comparePosition is closer to the beginning
@@ -122,21 +314,78 @@ private:
 	 */
 	bool changeUpdateInfo(std::list<unsigned __int64>::iterator comparePosition, std::ptrdiff_t compareOffset);
 	
-	///Rebuild part or all of the vertex buffer
+	///Record that the vertices from a string on must be rewritten
+	/*!
+	 * Calls changeUpdateInfo() outside of a batch, flags the string inside one.
+	 */
+	void markUpdate(std::list<unsigned __int64>::iterator position, std::ptrdiff_t offset);
+	
+	///Ask the backend for room for every glyph, counting and tracing a reallocation
+	void reserveStorage();
+	
+	///Insert a string into TextEngine::displayList in id order and mark it for update
+	/*!
+	 * Ids from addString() are always the largest and are appended. Queued ids may be
+	 * smaller than ids added since they were reserved; they are inserted before the
+	 * next larger id, found in TextEngine::display, so the list stays sorted by id.
+	 */
+	void insertString(unsigned __int64 id, const std::string &s, const glm::ivec2 &origin, const glm::vec3 &color);
+	
+	///Drain TextEngine::queue and apply the last write of every field per id
+	/*!
+	 * Commands are merged per id before any is applied, so a label updated many
+	 * times between frames is reformatted once, and a string added and removed in
+	 * the same frame is never inserted. The merged commands are applied as a batch.
+	 * Only the commands queued before the call are drained, so producers cannot keep
+	 * a frame from finishing.
+	 */
+	void applyQueue();
+	
+	///Allocate a command for TextEngine::queue
+	static MutationQueue::Command* makeCommand(MutationQueue::Op op, unsigned __int64 id);
+	
+	///Rebuild part or all of the vertex storage
 	/*!
 	 * Only called when updates are necessary.
-	 * Begins by reallocating a larger VBO if necessary, then walks the id list starting from the update index.
-	 * The updated data is copied into the VBO starting from the offset of the deleted string closest to the start of the buffer.
-	 * For each string after the update location on TextEngine::displayList, the data is formatted and applied to the VBO using TextEngine::loadString().
-	 * The offset into the VBO for that id is then updated to reflect its new position.
+	 * Begins by asking the backend to reserve room for every glyph, then maps the storage from the
+	 * offset of the changed string closest to the start of the buffer to the end of the last string.
+	 * The mapped range is filled by TextEngine::formatVertices(), or TextEngine::formatCodePoints()
+	 * when the backend expands code points itself.
 	 * TextEngine::updateIterator, TextEngine::updateIndex are then reset to reference the end of the list.
 	 */
 	void updateBuffer();
 	
-	///Copy formatted string data to VBO
+	///Format every string from TextEngine::updateIterator into a span
 	/*!
-	 * \param offset pointer to the location in VBO where the string data should be copied
-	 * \param id id of the string to copy
+	 * \param[out] span Destination of the vertices, the first byte corresponds to TextEngine::updateOffset
+	 *
+	 * For each string the data is formatted with TextEngine::loadString() and the offset
+	 * of the string is updated to reflect its new position. At or above
+	 * TextEngine::parallelGlyphs dirty glyphs, the work is handed to formatParallel().
+	 * \return Number of strings formatted
+	 */
+	unsigned formatVertices(unsigned char *span);
+	
+	///Format the strings from TextEngine::updateIterator on TextEngine::pool
+	/*!
+	 * A serial pass assigns every string its offset and splits the strings into chunks,
+	 * then the chunks are formatted concurrently. Each string is written by one thread only.
+	 * \return Number of strings formatted
+	 */
+	unsigned formatParallel(unsigned char *span, unsigned dirtyGlyphs);
+	
+	///Write the code points and string records of every string from TextEngine::updateIterator
+	/*!
+	 * Code points are written in the order of the vertices they become, one string record
+	 * (origin, first vertex, glyph count, color) per string.
+	 * \return Number of strings written
+	 */
+	unsigned formatCodePoints(unsigned char *codes, unsigned char *runs);
+	
+	///Copy formatted string data to the vertex storage
+	/*!
+	 * \param offset pointer to the location in the vertex storage where the string data should be copied
+	 * \param ref the string to copy
 	 *
 	 * Starts at the origin associated with the id.
 	 * Takes each character from the associated string and puts the
@@ -144,12 +393,29 @@ private:
 	 * the buffer.
 	 * The local origin's X coordinate is moved after each character
 	 * by that character's advance.
+	 * The bounding box of the glyph quads is stored in the string's Info for culling.
+	 * The pen is tracked in 26.6 fixed point; when the manager baked subpixel
+	 * phases, the glyph variant nearest to the fractional pen position is
+	 * chosen and the origin written to the buffer stays on a whole pixel.
+	 * Only reads the manager and writes ref, so strings may be loaded concurrently.
 	 */
-	void loadString(unsigned char *offset, unsigned __int64 id);
+	void loadString(unsigned char *offset, Info &ref) const;
 	
-	///Fill out the SSBO in the vertex shader with the details for each glyph
-	/*!
-	 *
-	 */
-	void loadMetaInfo();
+	///Start the frame's counters and the backend's frame, then update the buffer if needed
+	void beginFrame();
+	
+	///End the backend's frame, record its error and finish the frame's counters
+	void endFrame();
+	
+	///Count a mutation and record it in the trace
+	void recordMutation(const char *name, unsigned __int64 id, unsigned __int64 glyphCount);
+	
+	///Fill TextEngine::drawFirst and TextEngine::drawCount with the strings that overlap the viewport
+	void cull(const glm::ivec4 &viewport);
+	
+	///Draw the static blocks that overlap a viewport, or all of them if viewport is nullptr
+	void drawStaticBlocks(const glm::ivec4 *viewport);
+	
+	///Whether a bounding box (low X, low Y, high X, high Y) lies entirely outside a viewport, always true for an empty viewport
+	static bool outside(const glm::ivec4 &bounds, const glm::ivec4 &viewport);
 };
\ No newline at end of file
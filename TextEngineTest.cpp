@@ -0,0 +1,287 @@
+#include "TextEngineTest.h"
+
+/*
+	Consistency test of the mutation paths of TextEngine.
+	
+	Usage: TextEngineTest [font.ttf]
+	Random add/update/remove sequences are applied to three engines: one through
+	the direct mutators, one with every frame's mutations in a batch and one
+	through the mutation queue. After each frame, the vertices and draw ranges of
+	each engine must equal those of an engine rebuilt from scratch with the
+	expected strings. A second run queues from several producer threads while the
+	render thread draws, and checks that no frame drains commands queued after it
+	began, which could keep render() from returning. Everything runs
+	against RecordingBackend, so no context is needed. Returns 0 when every check
+	passed.
+*/
+
+namespace
+{
+	const unsigned SEEDS = 4;
+	const unsigned FRAMES = 1000; ///< Frames per seed
+	const unsigned MUTATIONS = 40; ///< Most mutations applied in one frame
+	const unsigned PRODUCERS = 4;
+	const unsigned PRODUCER_PUSHES = 100000; ///< Commands queued by each producer
+	const unsigned PRODUCER_STRINGS = 32; ///< Most strings alive per producer
+	
+	///Printable ASCII, possibly empty
+	std::string random_line(std::minstd_rand &rng)
+	{
+		std::string line(rng() % 12, ' ');
+		for(char &c : line)
+			c = static_cast<char>(32 + rng() % 95);
+		return line;
+	}
+	
+	Label random_label(std::minstd_rand &rng)
+	{
+		Label label;
+		label.str = random_line(rng);
+		label.origin = glm::ivec2{ static_cast<int>(rng() % 400), static_cast<int>(rng() % 400) };
+		label.color = glm::vec3{ (rng() % 4) * 0.25f, (rng() % 4) * 0.25f, 1.0f };
+		return label;
+	}
+	
+	///Draw a frame, either everything or through a random viewport so culled ranges are compared too
+	void render(Subject &subject, bool culled, const glm::ivec4 &viewport)
+	{
+		if(culled)
+			subject.engine.render(viewport);
+		else
+			subject.engine.render();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *fontPath = argc > 1 ? argv[1] : "Mecha.ttf";
+	
+	FT_Library ft;
+	if(FT_Init_FreeType(&ft))
+		return 1;
+	
+	unsigned mismatches = 0;
+	{
+		FontManager manager{ ft, fontPath, 0, 16, 32, 127, 2 };
+		manager.bakeTextureAtlas();
+		
+		for(unsigned seed = 1; seed <= SEEDS; seed++)
+			mismatches += run_sequence(manager, seed, FRAMES);
+		
+		mismatches += run_producers(manager, PRODUCERS, PRODUCER_PUSHES);
+	}
+	
+	FT_Done_FreeType(ft);
+	
+	if(mismatches)
+		std::cout << mismatches << " mismatches" << std::endl;
+	else
+		std::cout << "All mutation paths match a rebuilt engine" << std::endl;
+	
+	return mismatches ? 1 : 0;
+}
+
+Subject::Subject(const char *n, const FontManager &mgr) :
+	name{ n }, backend{ 5 }, engine{ mgr, backend }
+{
+}
+
+unsigned run_sequence(const FontManager &mgr, unsigned seed, unsigned frames)
+{
+	Subject direct{ "direct", mgr }, batched{ "batched", mgr }, queued{ "queued", mgr };
+	Subject *subjects[] = { &direct, &batched, &queued };
+	
+	std::map<unsigned __int64, Label> expected;
+	std::vector<unsigned __int64> ids;
+	std::minstd_rand rng{ seed };
+	unsigned mismatches = 0;
+	
+	for(unsigned frame = 0; frame < frames; frame++)
+	{
+		const unsigned mutations = rng() % MUTATIONS;
+		batched.engine.beginBatch();
+		
+		for(unsigned m = 0; m < mutations; m++)
+		{
+			const unsigned op = ids.empty() ? 0 : rng() % 5;
+			const std::size_t slot = ids.empty() ? 0 : rng() % ids.size();
+			Label label = random_label(rng);
+			
+			switch(op)
+			{
+			case 0:
+			{
+				unsigned __int64 id = direct.engine.addString(label.str, label.origin, label.color);
+				if(batched.engine.addString(label.str, label.origin, label.color) != id ||
+					queued.engine.queueAdd(label.str, label.origin, label.color) != id)
+				{
+					std::cout << "Seed " << seed << " frame " << frame << ": engines gave different ids" << std::endl;
+					return mismatches + 1;
+				}
+				ids.push_back(id);
+				expected[id] = label;
+				break;
+			}
+			case 1:
+				direct.engine.removeString(ids[slot]);
+				batched.engine.removeString(ids[slot]);
+				queued.engine.queueRemove(ids[slot]);
+				expected.erase(ids[slot]);
+				ids[slot] = ids.back();
+				ids.pop_back();
+				break;
+			case 2:
+				direct.engine.updateString(ids[slot], label.str);
+				batched.engine.updateString(ids[slot], label.str);
+				queued.engine.queueString(ids[slot], label.str);
+				expected[ids[slot]].str = label.str;
+				break;
+			case 3:
+				direct.engine.updateOrigin(ids[slot], label.origin);
+				batched.engine.updateOrigin(ids[slot], label.origin);
+				queued.engine.queueOrigin(ids[slot], label.origin);
+				expected[ids[slot]].origin = label.origin;
+				break;
+			default:
+				direct.engine.updateColor(ids[slot], label.color);
+				batched.engine.updateColor(ids[slot], label.color);
+				queued.engine.queueColor(ids[slot], label.color);
+				expected[ids[slot]].color = label.color;
+				break;
+			}
+		}
+		
+		batched.engine.commitBatch();
+		if(frame % 7 == 0)
+			direct.engine.invalidate(); //A full rewrite must not disturb the incremental state either
+		
+		const bool culled = rng() % 2 != 0;
+		const glm::ivec4 viewport{ static_cast<int>(rng() % 300), static_cast<int>(rng() % 300), 100, 100 };
+		
+		//Strings are laid out in id order, so adding them in that order gives the same vertex storage
+		Subject rebuilt{ "rebuilt", mgr };
+		for(auto &entry : expected)
+		{
+			Label label = entry.second;
+			rebuilt.engine.addString(label.str, label.origin, label.color);
+		}
+		render(rebuilt, culled, viewport);
+		
+		for(Subject *subject : subjects)
+		{
+			render(*subject, culled, viewport);
+			if(!matches(*subject, rebuilt))
+			{
+				std::cout << "Seed " << seed << " frame " << frame << ": " << subject->name << " differs from a rebuilt engine" << std::endl;
+				mismatches++;
+			}
+		}
+	}
+	
+	return mismatches;
+}
+
+unsigned run_producers(const FontManager &mgr, unsigned producers, unsigned pushes)
+{
+	Subject queued{ "queued", mgr };
+	std::vector<std::map<unsigned __int64, Label>> expected(producers); //One per producer, each only touches its own strings
+	std::vector<std::thread> threads;
+	std::atomic<unsigned __int64> pushed{ 0 }; ///< Commands whose queue call has returned
+	std::atomic<unsigned> running{ producers };
+	
+	for(unsigned t = 0; t < producers; t++)
+	{
+		threads.emplace_back([&, t]
+		{
+			std::minstd_rand rng{ 1000 + t };
+			std::map<unsigned __int64, Label> &own = expected[t];
+			std::vector<unsigned __int64> ids;
+			
+			for(unsigned n = 0; n < pushes; n++)
+			{
+				Label label = random_label(rng);
+				const std::size_t slot = ids.empty() ? 0 : rng() % ids.size();
+				
+				if(ids.empty() || (ids.size() < PRODUCER_STRINGS && rng() % 3 == 0))
+				{
+					unsigned __int64 id = queued.engine.queueAdd(label.str, label.origin, label.color);
+					ids.push_back(id);
+					own[id] = label;
+				}
+				else if(rng() % 2 == 0)
+				{
+					queued.engine.queueString(ids[slot], label.str);
+					own[ids[slot]].str = label.str;
+				}
+				else
+				{
+					queued.engine.queueRemove(ids[slot]);
+					own.erase(ids[slot]);
+					ids[slot] = ids.back();
+					ids.pop_back();
+				}
+				
+				pushed.fetch_add(1);
+			}
+			
+			running.fetch_sub(1);
+		});
+	}
+	
+	unsigned frames = 0;
+	unsigned __int64 drained = 0;
+	bool overran = false;
+	
+	while(running.load() != 0)
+	{
+		//A frame may only drain what was queued before it began; at most one command per producer is linked but not yet counted
+		const unsigned __int64 limit = pushed.load() + producers;
+		queued.engine.render();
+		drained += queued.engine.stats().queuedCommands;
+		overran |= drained > limit;
+		frames++;
+	}
+	
+	for(std::thread &t : threads)
+		t.join();
+	
+	if(overran)
+	{
+		std::cout << "Producers: a frame drained commands queued after its render() began" << std::endl;
+		return 1;
+	}
+	
+	queued.engine.render(); //Every push has completed, so this drains the rest
+	
+	std::map<unsigned __int64, Label> merged;
+	for(auto &own : expected)
+		merged.insert(own.begin(), own.end());
+	
+	Subject rebuilt{ "rebuilt", mgr };
+	for(auto &entry : merged)
+	{
+		Label label = entry.second;
+		rebuilt.engine.addString(label.str, label.origin, label.color);
+	}
+	rebuilt.engine.render();
+	
+	if(!matches(queued, rebuilt))
+	{
+		std::cout << "Producers: queued engine differs from a rebuilt engine after " << frames << " frames" << std::endl;
+		return 1;
+	}
+	
+	return 0;
+}
+
+bool matches(const Subject &subject, const Subject &reference)
+{
+	const unsigned glyphs = subject.engine.glyphCount();
+	if(glyphs != reference.engine.glyphCount())
+		return false;
+	
+	if(std::memcmp(subject.backend.vertices(), reference.backend.vertices(), RenderBackend::VERTEX_BYTES * glyphs) != 0)
+		return false;
+	
+	return subject.backend.frameRanges() == reference.backend.frameRanges();
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FontManager.h"
+#include "TextEngine.h"
+#include "RecordingBackend.h"
+
+/*!
+ * \struct Label TextEngineTest.h
+ * \brief Expected state of a string, kept beside the engines under test.
+ */
+struct Label
+{
+	std::string str;
+	glm::ivec2 origin;
+	glm::vec3 color;
+};
+
+/*!
+ * \struct Subject TextEngineTest.h
+ * \brief An engine under test and the backend it writes into.
+ */
+struct Subject
+{
+	const char *name;
+	RecordingBackend backend;
+	TextEngine engine;
+
+	Subject(const char *n, const FontManager &mgr);
+};
+
+///Apply frames of random mutations through every mutation path and compare each frame with a rebuilt engine
+/*!
+ * \return The number of mismatches found, 0 if every path matched every frame
+ */
+unsigned run_sequence(const FontManager &mgr, unsigned seed, unsigned frames);
+
+///Render frames while other threads queue mutations as fast as they can, then compare with a rebuilt engine
+/*!
+ * Each producer adds, updates and removes its own strings. Fails if a frame drains
+ * commands queued after its render() began, or if the drained engine differs.
+ * \return The number of failures, 0 on success
+ */
+unsigned run_producers(const FontManager &mgr, unsigned producers, unsigned pushes);
+
+///Compare the vertices and draw ranges of the last frame of an engine with those of the reference
+bool matches(const Subject &subject, const Subject &reference);
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "TextTrace.h"
+#include <fstream>
+#include <sstream>
+
+TextTrace::TextTrace() : epoch{ Clock::now() }
+{
+}
+
+void TextTrace::instant(const char *name, unsigned long long id, unsigned long long glyphs)
+{
+	events.push_back(Event{ name, 'i', micros(Clock::now()), 0, id, glyphs, 0 });
+}
+
+void TextTrace::complete(const char *name, Clock::time_point start, Clock::time_point end, unsigned long long glyphs, unsigned long long bytes)
+{
+	events.push_back(Event{ name, 'X', micros(start), micros(end) - micros(start), 0, glyphs, bytes });
+}
+
+void TextTrace::clear()
+{
+	events.clear();
+	epoch = Clock::now();
+}
+
+std::size_t TextTrace::size() const
+{
+	return events.size();
+}
+
+std::string TextTrace::json() const
+{
+	std::ostringstream out;
+
+	out << "{\"traceEvents\":[";
+
+	for(std::size_t e = 0; e < events.size(); e++)
+	{
+		const Event &ev = events[e];
+
+		if(e) out << ',';
+		out << "\n{\"name\":\"" << ev.name << "\",\"cat\":\"text\",\"ph\":\"" << ev.phase
+			<< "\",\"ts\":" << ev.ts << ",\"pid\":0,\"tid\":0";
+
+		if(ev.phase == 'X')
+			out << ",\"dur\":" << ev.dur << ",\"args\":{\"glyphs\":" << ev.glyphs << ",\"bytes\":" << ev.bytes << '}';
+		else
+			out << ",\"s\":\"t\",\"args\":{\"id\":" << ev.id << ",\"glyphs\":" << ev.glyphs << '}';
+
+		out << '}';
+	}
+
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return out.str();
+}
+
+bool TextTrace::write(const char *path) const
+{
+	std::ofstream file{ path, std::ios::out | std::ios::trunc };
+
+	if(!file)
+		return false;
+
+	file << json();
+	return static_cast<bool>(file);
+}
+
+long long TextTrace::micros(Clock::time_point t) const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(t - epoch).count();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*!
+ * \class TextTrace TextTrace.h
+ * \brief Records text engine events and writes them in the Chrome trace event format.
+ *
+ * The output can be loaded in chrome://tracing or Perfetto. A trace is attached to
+ * a TextEngine with TextEngine::setTrace(); the engine then records every mutation
+ * as an instant event and every buffer update and frame as a complete event, so a
+ * slow frame can be attributed to the mutations recorded before it.
+ */
+class TextTrace
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	TextTrace();
+
+	///Record an event without duration
+	/*!
+	 * \param[in] name Event name, must be a string literal or otherwise outlive the trace
+	 * \param[in] id The string id the event applies to, or the error code for GL errors
+	 * \param[in] glyphs Glyph count associated with the event, the new capacity for reallocations
+	 */
+	void instant(const char *name, unsigned long long id, unsigned long long glyphs);
+
+	///Record an event with a duration
+	/*!
+	 * \param[in] name Event name, must be a string literal or otherwise outlive the trace
+	 * \param[in] start Time the event began
+	 * \param[in] end Time the event ended
+	 * \param[in] glyphs Glyph count associated with the event
+	 * \param[in] bytes Bytes associated with the event
+	 */
+	void complete(const char *name, Clock::time_point start, Clock::time_point end, unsigned long long glyphs, unsigned long long bytes);
+
+	///Discard recorded events and restart the time base
+	void clear();
+
+	///Number of recorded events
+	std::size_t size() const;
+
+	///Format the recorded events as a Chrome trace JSON document
+	std::string json() const;
+
+	///Write json() to a file
+	/*!
+	 * \return true if the file could be written
+	 */
+	bool write(const char *path) const;
+
+private:
+	struct Event
+	{
+		const char *name;
+		char phase; ///< 'i' for instant, 'X' for complete
+		long long ts; ///< Microseconds since the time base
+		long long dur; ///< Microseconds, complete events only
+		unsigned long long id;
+		unsigned long long glyphs;
+		unsigned long long bytes;
+	};
+
+	Clock::time_point epoch; ///< Time base of the trace
+	std::vector<Event> events;
+
+	long long micros(Clock::time_point t) const;
+};
@@ -0,0 +1,81 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned threads) :
+	job{ nullptr }, jobCount{ 0 }, nextIndex{ 0 }, busy{ 0 }, generation{ 0 }, stop{ false }
+{
+	for(unsigned i = 1; i < threads; i++)
+		workers.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard{ lock };
+		stop = true;
+	}
+	wake.notify_all();
+
+	for(std::thread &t : workers)
+		t.join();
+}
+
+unsigned WorkerPool::size() const
+{
+	return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void WorkerPool::parallelFor(unsigned count, const std::function<void(unsigned)> &task)
+{
+	if(workers.empty() || count < 2)
+	{
+		for(unsigned i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard{ lock };
+		job = &task;
+		jobCount = count;
+		nextIndex.store(0, std::memory_order_relaxed);
+		busy = static_cast<unsigned>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+
+	drain();
+
+	std::unique_lock<std::mutex> guard{ lock };
+	done.wait(guard, [this] { return busy == 0; });
+	job = nullptr;
+}
+
+void WorkerPool::drain()
+{
+	for(unsigned i = nextIndex.fetch_add(1); i < jobCount; i = nextIndex.fetch_add(1))
+		(*job)(i);
+}
+
+void WorkerPool::workerLoop()
+{
+	unsigned seen = 0;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard{ lock };
+			wake.wait(guard, [this, seen] { return stop || generation != seen; });
+			if(stop)
+				return;
+			seen = generation;
+		}
+
+		drain();
+
+		{
+			std::lock_guard<std::mutex> guard{ lock };
+			busy--;
+		}
+		done.notify_one();
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * \class WorkerPool WorkerPool.h
+ * \brief Fixed set of threads running the iterations of a parallel loop.
+ *
+ * The calling thread takes part in every loop, so a pool of size() threads
+ * starts size() - 1 workers. Workers sleep between loops.
+ */
+class WorkerPool
+{
+public:
+	///Start threads - 1 workers
+	/*!
+	 * \param[in] threads Threads running each loop, including the caller, at least 1
+	 */
+	explicit WorkerPool(unsigned threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	///Threads running each loop, including the caller
+	unsigned size() const;
+
+	///Call task(i) for every i in [0, count) and return once every call has finished
+	/*!
+	 * Iterations are handed out one at a time, so they may take unequal time.
+	 * Only one thread may run a loop at a time.
+	 */
+	void parallelFor(unsigned count, const std::function<void(unsigned)> &task);
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake; ///< Signals workers that a loop started or the pool stops
+	std::condition_variable done; ///< Signals the caller that a worker finished the loop
+	const std::function<void(unsigned)> *job; ///< Loop body, valid while a loop runs
+	unsigned jobCount;
+	std::atomic<unsigned> nextIndex; ///< Next iteration to hand out
+	unsigned busy; ///< Workers that have not finished the current loop
+	unsigned generation; ///< Incremented for every loop so workers run each once
+	bool stop;
+
+	///Run iterations of the current loop until none are left
+	void drain();
+
+	void workerLoop();
+};
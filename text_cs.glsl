@@ -0,0 +1,89 @@
+#version 450 core
+
+//One invocation lays out one string
+layout(local_size_x = 64) in;
+
+struct Meta
+{
+    int ax; // X advance
+	int ay; // Y advance
+	uint bw; // Bitmap width
+	uint bh; // Bitmap rows
+	int lb; // Left bearing
+	int tb; // Top bearing
+	
+	//OpenGL texel coordinates with origin in lower left
+	int tx; // Texel X base
+	int ty; // Texel Y base
+};
+
+struct Run
+{
+	int ox; // Origin X
+	int oy; // Origin Y
+	uint first; // First glyph of the string in the vertex buffer
+	uint count; // Number of glyphs
+	float r;
+	float g;
+	float b;
+	float pad;
+};
+
+layout(std430, binding = 0) readonly buffer AtlasMap
+{
+	Meta meta[];
+} glyph;
+
+layout(std430, binding = 1) readonly buffer Strings
+{
+	Run run[];
+} strings;
+
+layout(std430, binding = 2) readonly buffer CodePoints
+{
+	uint code[]; // Indexed by vertex, only the range written by the dispatch is valid
+} text;
+
+//The vertex buffer, 6 words per glyph: ivec2 origin, vec3 color, uint index
+layout(std430, binding = 3) writeonly buffer Vertices
+{
+	uint word[];
+} vbo;
+
+layout(location = 0) uniform uint charbase;
+layout(location = 1) uniform uint phases;
+layout(location = 2) uniform uint runs;
+
+void main()
+{
+	const uint s = gl_GlobalInvocationID.x;
+	if(s >= runs)
+		return;
+
+	const Run str = strings.run[s];
+	int pen = str.ox * 64; // 26.6 pen position, same rounding as TextEngine::loadString
+
+	for(uint i = 0; i < str.count; i++)
+	{
+		const uint v = str.first + i;
+
+		int x = pen >> 6;
+		uint phase = (uint(pen & 63) * phases + 32) >> 6;
+		if(phase == phases)
+		{
+			x++;
+			phase = 0;
+		}
+
+		const uint index = (text.code[v] - charbase) * phases + phase;
+
+		vbo.word[v * 6 + 0] = uint(x);
+		vbo.word[v * 6 + 1] = uint(str.oy);
+		vbo.word[v * 6 + 2] = floatBitsToUint(str.r);
+		vbo.word[v * 6 + 3] = floatBitsToUint(str.g);
+		vbo.word[v * 6 + 4] = floatBitsToUint(str.b);
+		vbo.word[v * 6 + 5] = index;
+
+		pen += glyph.meta[index].ax;
+	}
+}
\ No newline at end of file